@@ -92,7 +92,9 @@ wait (struct intq *q UNUSED, struct thread **waiter)
           || (waiter == &q->not_full && intq_full (q)));
 
   *waiter = thread_current ();
+  spinlock_acquire (&sched_lock);
   thread_block ();
+  spinlock_release (&sched_lock, INTR_OFF);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -108,7 +110,9 @@ signal (struct intq *q UNUSED, struct thread **waiter)
 
   if (*waiter != NULL) 
     {
+      enum intr_level old_level = spinlock_acquire (&sched_lock);
       thread_unblock (*waiter);
+      spinlock_release (&sched_lock, old_level);
       *waiter = NULL;
     }
 }
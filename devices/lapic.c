@@ -0,0 +1,193 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC.
+
+   Each CPU has a local APIC, which delivers interrupts to it and
+   lets it send interrupts to other CPUs, called inter-processor
+   interrupts or IPIs.  Its registers are memory-mapped at the
+   same physical address on every CPU, with each CPU seeing its
+   own.  See [IA32-v3a] chapter "Advanced Programmable
+   Interrupt Controller (APIC)".
+
+   Devices still interrupt through the 8259A PICs, which the BIOS
+   wires to the bootstrap processor's LINT0 pin, so we use the
+   local APICs only for IPIs. */
+
+/* Register offsets. */
+#define ID_REG 0x020            /* Local APIC ID. */
+#define TPR_REG 0x080           /* Task Priority Reg. */
+#define EOI_REG 0x0b0           /* End Of Interrupt Reg. (write-only). */
+#define SVR_REG 0x0f0           /* Spurious Interrupt Vector Reg. */
+#define ESR_REG 0x280           /* Error Status Reg. */
+#define ICR_LO_REG 0x300        /* Interrupt Command Reg., bits 0...31. */
+#define ICR_HI_REG 0x310        /* Interrupt Command Reg., bits 32...63. */
+#define TIMER_REG 0x320         /* LVT Timer Reg. */
+#define LINT0_REG 0x350         /* LVT LINT0 Reg. */
+#define LINT1_REG 0x360         /* LVT LINT1 Reg. */
+#define ERROR_REG 0x370         /* LVT Error Reg. */
+
+/* SVR bits. */
+#define SVR_ENABLE 0x100        /* APIC software enable. */
+
+/* LVT bits. */
+#define LVT_MASKED 0x10000      /* Interrupt masked. */
+
+/* ICR bits. */
+#define ICR_FIXED 0x000         /* Deliver the vector given. */
+#define ICR_INIT 0x500          /* Deliver INIT. */
+#define ICR_STARTUP 0x600       /* Deliver startup IPI. */
+#define ICR_PENDING 0x1000      /* Delivery status: still sending. */
+#define ICR_ASSERT 0x4000       /* Level: assert. */
+#define ICR_LEVEL 0x8000        /* Trigger mode: level. */
+
+/* The registers, mapped at their physical address. */
+static volatile uint32_t *regs;
+
+static uint32_t read_reg (int reg);
+static void write_reg (int reg, uint32_t value);
+static void send (uint8_t apic_id, uint32_t command);
+
+/* Maps the local APIC registers, which are at physical address
+   PADDR, into init_page_dir at the same virtual address,
+   uncached.  Must be called before any process page directory
+   is created, because those copy init_page_dir's kernel
+   mappings.  Returns false if PADDR cannot be mapped that way,
+   because it is not page-aligned or it falls where the kernel
+   maps RAM. */
+bool
+lapic_map (uintptr_t paddr)
+{
+  uint8_t *vaddr = (uint8_t *) paddr;
+  uint32_t *pde, *pt;
+
+  if (pg_ofs (vaddr) != 0
+      || vaddr < (uint8_t *) ptov (init_ram_pages * PGSIZE))
+    return false;
+
+  pde = init_page_dir + pd_no (vaddr);
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (*pde);
+  pt[pt_no (vaddr)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+
+  regs = (volatile uint32_t *) vaddr;
+  return true;
+}
+
+/* Sets up the running CPU's local APIC.  BSP is true on the
+   bootstrap processor, which keeps the BIOS's settings for the
+   LINT0 and LINT1 pins that connect it to the PICs. */
+void
+lapic_init (bool bsp)
+{
+  ASSERT (regs != NULL);
+
+  /* Enable the local APIC, with spurious interrupts at
+     LAPIC_SPURIOUS. */
+  write_reg (SVR_REG, SVR_ENABLE | LAPIC_SPURIOUS);
+
+  /* We do not use the local APIC timer or the error interrupt,
+     and only the bootstrap processor hears from the PICs. */
+  write_reg (TIMER_REG, LVT_MASKED);
+  write_reg (ERROR_REG, LVT_MASKED);
+  if (!bsp)
+    {
+      write_reg (LINT0_REG, LVT_MASKED);
+      write_reg (LINT1_REG, LVT_MASKED);
+    }
+
+  /* Clear errors, which takes two writes, acknowledge anything
+     outstanding, and accept interrupts of every priority. */
+  write_reg (ESR_REG, 0);
+  write_reg (ESR_REG, 0);
+  write_reg (EOI_REG, 0);
+  write_reg (TPR_REG, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  return read_reg (ID_REG) >> 24;
+}
+
+/* Acknowledges the interrupt being handled, so that the local
+   APIC will deliver others. */
+void
+lapic_eoi (void)
+{
+  write_reg (EOI_REG, 0);
+}
+
+/* Sends an IPI with vector VEC to the CPU with local APIC ID
+   APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  send (apic_id, ICR_FIXED | ICR_ASSERT | vec);
+}
+
+/* Starts the application processor with local APIC ID APIC_ID
+   running in real mode at physical address START, which must be
+   page-aligned and below 1 MB.  Follows the INIT-SIPI-SIPI
+   sequence of [IA32-v3a] "Typical BSP Initialization
+   Sequence". */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t start)
+{
+  int i;
+
+  ASSERT (start % PGSIZE == 0 && start < 0x100000);
+
+  send (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  send (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_mdelay (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      send (apic_id, ICR_STARTUP | (start >> 12));
+      timer_udelay (200);
+    }
+}
+
+/* Returns the value of register REG. */
+static uint32_t
+read_reg (int reg)
+{
+  return regs[reg / sizeof *regs];
+}
+
+/* Writes VALUE to register REG, then waits for the write to
+   finish by reading the ID register. */
+static void
+write_reg (int reg, uint32_t value)
+{
+  regs[reg / sizeof *regs] = value;
+  read_reg (ID_REG);
+}
+
+/* Sends an interrupt COMMAND to the CPU with local APIC ID
+   APIC_ID and waits for it to be delivered.  Interrupts are
+   turned off meanwhile, so that an interrupt handler that sends
+   an IPI does not overwrite the command half-written. */
+static void
+send (uint8_t apic_id, uint32_t command)
+{
+  enum intr_level old_level = intr_disable_local ();
+
+  write_reg (ICR_HI_REG, (uint32_t) apic_id << 24);
+  write_reg (ICR_LO_REG, command);
+  while (read_reg (ICR_LO_REG) & ICR_PENDING)
+    asm volatile ("pause");
+
+  intr_set_level_local (old_level);
+}
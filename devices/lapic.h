@@ -0,0 +1,20 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  They are above
+   those used by the PICs (0x20...0x2f) and for system calls
+   (0x30). */
+#define LAPIC_VEC_MIN 0xf0      /* Lowest vector for IPIs. */
+#define LAPIC_SPURIOUS 0xff     /* Spurious interrupt vector. */
+
+bool lapic_map (uintptr_t paddr);
+void lapic_init (bool bsp);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uintptr_t start);
+
+#endif /* devices/lapic.h */
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/spinlock.h"
 
 /* Interface to 8254 Programmable Interrupt Timer (PIT).
    Refer to [8254] for details. */
@@ -11,8 +12,10 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
+/* Serializes access to the PIT's ports, which take several
+   accesses in a row to program or read a channel.  A spinlock,
+   so that the timer can program the PIT under its own. */
+static struct spinlock pit_lock = SPINLOCK_INITIALIZER;
 
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
@@ -35,6 +38,10 @@
        of the period.  This is useful for hooking up to an
        interrupt controller to generate a periodic interrupt.
 
+     - Mode 0, set up by pit_start_one_shot(), is a one-shot
+       timer: the output goes to 1 at the end of the count and
+       stays there until the channel is reprogrammed.
+
      - Mode 3 is a square wave: for the first half of the period
        it is 1, for the second half it is 0.  This is useful for
        generating a tone on a speaker.
@@ -75,9 +82,52 @@ pit_configure_channel (int channel, int mode, int frequency)
     count = (PIT_HZ + frequency / 2) / frequency;
 
   /* Configure the PIT mode and load its counters. */
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&pit_lock);
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
   outb (PIT_PORT_COUNTER (channel), count);
   outb (PIT_PORT_COUNTER (channel), count >> 8);
-  intr_set_level (old_level);
+  spinlock_release (&pit_lock, old_level);
+}
+
+/* Starts CHANNEL counting down from COUNT PIT cycles, in mode 0,
+   so that its output goes to 1 once, at the end of the count.
+   On channel 0, that raises a single timer interrupt.  A COUNT of
+   0 counts 65536 cycles. */
+void
+pit_start_one_shot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = spinlock_acquire (&pit_lock);
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  spinlock_release (&pit_lock, old_level);
+}
+
+/* Returns CHANNEL's current count and stores the state of its
+   output in *OUTPUT.  For a one-shot count, the output is true
+   once the count has run out, after which the count itself is
+   meaningless. */
+uint16_t
+pit_read_count (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* The read-back command latches the status and the count
+     together, so that they describe the same instant. */
+  old_level = spinlock_acquire (&pit_lock);
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  spinlock_release (&pit_lock, old_level);
+
+  *output = (status & 0x80) != 0;
+  return low | (high << 8);
 }
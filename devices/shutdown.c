@@ -5,14 +5,25 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -120,6 +131,11 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  palloc_print_stats ();
+#ifdef LOCK_STAT
+  lock_stat_print ();
+#endif
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -127,5 +143,13 @@ print_stats (void)
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
+  prefetch_print_stats ();
+  ksm_print_stats ();
+  swap_print_stats ();
 #endif
 }
@@ -1,10 +1,12 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -17,14 +19,84 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted, not counting those of
+   a tickless period in progress. */
 static int64_t ticks;
 
+/* Protects the tick count, the tickless state, and the timer
+   wheel.  Only the BSP takes timer interrupts, but threads on any
+   CPU read the time and arm timeouts.  Acquired after sched_lock,
+   not before, because thread_unblock() ends tickless periods. */
+static struct spinlock timer_lock;
+
+/* Tickless operation.
+
+   Normally the PIT interrupts every tick.  In tickless mode,
+   when no thread is waiting for the CPU, so that there is nothing
+   to time-slice, the timer interrupt instead programs the PIT for
+   a single interrupt at the next tick that needs one: the next
+   tick with a timeout due, or the furthest the 16-bit PIT counter
+   reaches, whichever is sooner.  That interrupt accounts for all
+   the ticks that passed, calling thread_tick() for each, and
+   returns the PIT to periodic mode.  In between, timer_ticks()
+   adds in the whole ticks that have passed by reading the PIT.
+
+   A thread becoming ready, or a timeout armed for a tick before
+   the interrupt, ends the tickless period early, at the next tick
+   boundary. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define MAX_TICKLESS (UINT16_MAX / TICK_CYCLES)
+
+static bool tickless;           /* Tickless mode enabled? */
+static bool calibrated;         /* timer_calibrate() done? */
+static int tickless_ticks;      /* Ticks in this period, 0 if ticking. */
+static unsigned tickless_base;  /* Cycles elapsed when PIT was set. */
+static unsigned tickless_count; /* Cycles the PIT was set for. */
+
+/* Timer wheel.
+
+   Pending timeouts are kept in a hierarchical timer wheel, so
+   that arming or cancelling one takes constant time however many
+   are pending.  There are WHEEL_LEVELS levels of WHEEL_SIZE slots
+   each.  A timeout that expires less than WHEEL_SIZE ticks from
+   now goes in level 0, in the slot for its expiry tick; one that
+   expires less than WHEEL_SIZE**2 ticks from now goes in level 1,
+   in the slot for its expiry tick divided by WHEEL_SIZE; and so
+   on.  Each tick, timer_interrupt() fires the timeouts in the
+   current level-0 slot.  Each time level 0 wraps around, the
+   current level-1 slot is "cascaded": its timeouts are put back
+   in the wheel, which now places them in level 0, and likewise
+   for higher levels when level 1 wraps.
+
+   Timeouts that expire further off than the wheel covers sit in
+   the top level until they come within range.
+
+   The wheel is protected by timer_lock. */
+#define WHEEL_BITS 6                    /* Bits of expiry per level. */
+#define WHEEL_SIZE (1 << WHEEL_BITS)    /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                  /* Number of levels. */
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Last tick for which the wheel fired timeouts. */
+static int64_t wheel_ticks;
+
+/* Statistics. */
+static long long fire_cnt;      /* Timeouts fired. */
+static long long cascade_cnt;   /* Timeouts moved to a lower level. */
+static long long skip_cnt;      /* Ticks without a timer interrupt. */
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static int64_t ticks_now (void);
+static int64_t tickless_elapsed (void);
+static void stop_ticking (void);
+static void resume_ticks (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,7 +107,13 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  int level, slot;
+
+  spinlock_init (&timer_lock);
   pit_configure_channel (0, 2, TIMER_FREQ);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -64,15 +142,42 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Calibration counts loops between consecutive ticks, so it
+     must finish before ticks can be skipped. */
+  calibrated = true;
+}
+
+/* Enables or disables tickless mode, as described above.
+   Disabling it ends any tickless period at the next tick. */
+void
+timer_set_tickless (bool enable)
+{
+  enum intr_level old_level = spinlock_acquire (&timer_lock);
+  tickless = enable;
+  if (!enable)
+    resume_ticks ();
+  spinlock_release (&timer_lock, old_level);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
+  enum intr_level old_level = spinlock_acquire (&timer_lock);
+  int64_t t = ticks_now ();
+  spinlock_release (&timer_lock, old_level);
+  return t;
+}
+
+/* Returns the number of timer ticks since the OS booted.
+   timer_lock must be held. */
+static int64_t
+ticks_now (void)
+{
   int64_t t = ticks;
-  intr_set_level (old_level);
+  if (tickless_ticks != 0)
+    t += tickless_elapsed ();
   return t;
 }
 
@@ -84,16 +189,260 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Puts timeout T in the slot of the wheel where it belongs,
+   given its expiry tick.  timer_lock must be held. */
+static void
+enqueue_timeout (struct timeout *t)
+{
+  int64_t expires = t->expires;
+  int level;
+
+  /* A timeout that is already due fires on the next tick, and one
+     that is out of range waits in the top level. */
+  if (expires <= wheel_ticks)
+    expires = wheel_ticks + 1;
+  else if (expires - wheel_ticks >= WHEEL_SPAN)
+    expires = wheel_ticks + WHEEL_SPAN - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (expires - wheel_ticks < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Initializes timeout T to call FUNC, passing AUX, when it
+   fires.  T is not armed. */
+void
+timeout_init (struct timeout *t, timeout_func *func, void *aux)
+{
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms timeout T to fire TICKS timer ticks from now, or on the
+   next tick if TICKS <= 0.  If T is already armed, it is moved to
+   the new time.  T's function will be called from the timer
+   interrupt handler, with interrupts off, so it must not sleep.
+   It is called without timer_lock held, so it may arm timeouts
+   itself. */
+void
+timeout_add (struct timeout *t, int64_t ticks)
+{
+  enum intr_level old_level = spinlock_acquire (&timer_lock);
+
+  if (t->pending)
+    list_remove (&t->elem);
+  t->expires = ticks_now () + ticks;
+  t->pending = true;
+  enqueue_timeout (t);
+
+  /* Start ticking again, so that the next tick sets up a tickless
+     period that takes T into account. */
+  resume_ticks ();
+  spinlock_release (&timer_lock, old_level);
+}
+
+/* Disarms timeout T.  Returns true if T was armed, false if it
+   had already fired or was never armed. */
+bool
+timeout_cancel (struct timeout *t)
+{
+  enum intr_level old_level = spinlock_acquire (&timer_lock);
+  bool was_pending = t->pending;
+
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  spinlock_release (&timer_lock, old_level);
+  return was_pending;
+}
+
+/* Moves every timeout in SLOT to the local list CHOSEN. */
+static void
+take_slot (struct list *slot, struct list *chosen)
+{
+  list_init (chosen);
+  if (!list_empty (slot))
+    list_splice (list_end (chosen), list_begin (slot), list_end (slot));
+}
+
+/* Advances the wheel to the current tick, firing the timeouts
+   that have expired.  Called from the timer interrupt, holding
+   timer_lock, which is released while each timeout's function
+   runs.  A timeout still on CHOSEN meanwhile may be cancelled or
+   re-armed, which takes it off. */
+static void
+run_timeouts (void)
+{
+  while (wheel_ticks < ticks)
+    {
+      struct list chosen;
+      int level;
+
+      wheel_ticks++;
+
+      /* Cascade, from the highest level that is due down, so
+         that timeouts can fall more than one level at once. */
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        if ((wheel_ticks & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) != 0)
+          break;
+      while (--level > 0)
+        {
+          int slot = (wheel_ticks >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+          take_slot (&wheel[level][slot], &chosen);
+          while (!list_empty (&chosen))
+            {
+              struct timeout *t = list_entry (list_pop_front (&chosen),
+                                              struct timeout, elem);
+              enqueue_timeout (t);
+              cascade_cnt++;
+            }
+        }
+
+      /* Fire. */
+      take_slot (&wheel[0][wheel_ticks & WHEEL_MASK], &chosen);
+      while (!list_empty (&chosen))
+        {
+          struct timeout *t = list_entry (list_pop_front (&chosen),
+                                          struct timeout, elem);
+          if (t->expires > wheel_ticks)
+            {
+              /* Was out of range when armed. */
+              enqueue_timeout (t);
+              continue;
+            }
+          t->pending = false;
+          fire_cnt++;
+          spinlock_unlock (&timer_lock);
+          t->func (t->aux);
+          spinlock_lock (&timer_lock);
+        }
+    }
+}
+
+/* Returns the number of whole ticks that have passed in the
+   current tickless period.  timer_lock must be held. */
+static int64_t
+tickless_elapsed (void)
+{
+  unsigned cycles;
+  bool done;
+  uint16_t count = pit_read_count (0, &done);
+
+  if (done)
+    return tickless_ticks;
+  cycles = tickless_base + (tickless_count - count);
+  if (cycles / TICK_CYCLES >= (unsigned) tickless_ticks)
+    return tickless_ticks;
+  return cycles / TICK_CYCLES;
+}
+
+/* Starts a tickless period, if no thread is waiting to run and
+   the next tick with work to do is at least 2 ticks away.  Called
+   from the timer interrupt, at a tick boundary, holding
+   timer_lock. */
+static void
+stop_ticking (void)
+{
+  int n;
+
+  if (!tickless || !calibrated || thread_ready_count () > 0)
+    return;
+
+  /* Find the next tick whose level-0 slot is not empty or that
+     cascades a higher level. */
+  for (n = 1; n < MAX_TICKLESS; n++)
+    {
+      int64_t tick = wheel_ticks + n;
+      if ((tick & WHEEL_MASK) == 0
+          || !list_empty (&wheel[0][tick & WHEEL_MASK]))
+        break;
+    }
+  if (n < 2)
+    return;
+
+  tickless_ticks = n;
+  tickless_base = 0;
+  tickless_count = n * TICK_CYCLES;
+  pit_start_one_shot (0, tickless_count);
+}
+
+/* Ends the current tickless period, if any, at the next tick
+   boundary, so that time slicing or an earlier timeout can go
+   ahead. */
+void
+timer_resume_ticks (void)
+{
+  enum intr_level old_level = spinlock_acquire (&timer_lock);
+  resume_ticks ();
+  spinlock_release (&timer_lock, old_level);
+}
+
+/* Does the work of timer_resume_ticks().  timer_lock must be
+   held. */
+static void
+resume_ticks (void)
+{
+  unsigned cycles;
+  bool done;
+  uint16_t count;
+
+  if (tickless_ticks == 0)
+    return;
+
+  /* If the count has run out, the interrupt is already due. */
+  count = pit_read_count (0, &done);
+  if (done)
+    return;
+  cycles = tickless_base + (tickless_count - count);
+  if (cycles / TICK_CYCLES + 1 >= (unsigned) tickless_ticks)
+    return;
+
+  tickless_ticks = cycles / TICK_CYCLES + 1;
+  tickless_base = cycles;
+  tickless_count = tickless_ticks * TICK_CYCLES - cycles;
+  pit_start_one_shot (0, tickless_count);
+}
+
+/* Wakes up sleeping thread T_. */
+static void
+wake_up (void *t_)
+{
+  struct thread *t = t_;
+  enum intr_level old_level = spinlock_acquire (&sched_lock);
+  thread_unblock (t);
+  spinlock_release (&sched_lock, old_level);
+  thread_preempt ();
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread blocks until a timeout wakes it, rather than taking
+   up time slices while it waits. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct timeout t;
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  /* Holding sched_lock until we block keeps wake_up() from trying
+     to unblock us first. */
+  timeout_init (&t, wake_up, thread_current ());
+  old_level = spinlock_acquire (&sched_lock);
+  timeout_add (&t, ticks);
+  thread_block ();
+  spinlock_release (&sched_lock, old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -164,14 +513,40 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timeouts: %lld fired, %lld cascaded\n", fire_cnt, cascade_cnt);
+  if (tickless)
+    printf ("Tickless: %lld ticks skipped\n", skip_cnt);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  int skipped = 0;
+
+  spinlock_lock (&timer_lock);
+  if (tickless_ticks != 0)
+    {
+      /* End of a tickless period.  Account for the ticks that
+         passed without an interrupt and go back to ticking. */
+      skipped = tickless_ticks - 1;
+      tickless_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      skip_cnt += skipped;
+    }
+
+  /* thread_tick() reads the time, so it runs without
+     timer_lock. */
+  for (; skipped >= 0; skipped--)
+    {
+      ticks++;
+      spinlock_unlock (&timer_lock);
+      thread_tick ();
+      spinlock_lock (&timer_lock);
+    }
+  run_timeouts ();
+  stop_ticking ();
+  spinlock_unlock (&timer_lock);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
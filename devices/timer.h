@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -9,6 +11,8 @@
 
 void timer_init (void);
 void timer_calibrate (void);
+void timer_set_tickless (bool);
+void timer_resume_ticks (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -19,6 +23,24 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* Function called when a timeout fires. */
+typedef void timeout_func (void *aux);
+
+/* A timeout: a function to be called from the timer interrupt
+   at a given tick. */
+struct timeout
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick at which to fire. */
+    bool pending;               /* Armed and not yet fired? */
+    timeout_func *func;         /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+  };
+
+void timeout_init (struct timeout *, timeout_func *, void *aux);
+void timeout_add (struct timeout *, int64_t ticks);
+bool timeout_cancel (struct timeout *);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
@@ -222,8 +222,14 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Read full sectors directly into caller's buffer.  A
+             file's sectors are contiguous, so read as many as we
+             can with a single request. */
+          off_t max_left = size < inode_left ? size : inode_left;
+          size_t sector_cnt = max_left / BLOCK_SECTOR_SIZE;
+          block_read_multiple (fs_device, sector_idx, sector_cnt,
+                               buffer + bytes_read);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -283,8 +289,13 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write full sectors directly to disk, as many as we
+             can with a single request. */
+          off_t max_left = size < inode_left ? size : inode_left;
+          size_t sector_cnt = max_left / BLOCK_SECTOR_SIZE;
+          block_write_multiple (fs_device, sector_idx, sector_cnt,
+                                buffer + bytes_written);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -161,9 +161,10 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+     is guaranteed to be atomic, even with more than one CPU.  See
+     the descriptions of the OR instruction and the LOCK prefix in
+     [IA32-v2b]. */
+  asm volatile ("lock orl %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -174,9 +175,10 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+     is guaranteed to be atomic, even with more than one CPU.  See
+     the descriptions of the AND instruction and the LOCK prefix in
+     [IA32-v2a]. */
+  asm volatile ("lock andl %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -189,9 +191,10 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+     is guaranteed to be atomic, even with more than one CPU.  See
+     the descriptions of the XOR instruction and the LOCK prefix in
+     [IA32-v2b]. */
+  asm volatile ("lock xorl %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
 }
 
 /* Returns the value of the bit numbered IDX in B. */
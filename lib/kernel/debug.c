@@ -22,7 +22,9 @@ debug_panic (const char *file, int line, const char *function,
   static int level;
   va_list args;
 
-  intr_disable ();
+  /* Not intr_disable(), which could wait forever for another CPU
+     that holds the interrupt lock. */
+  intr_disable_local ();
   console_panic ();
 
   level++;
@@ -0,0 +1,165 @@
+#include <lz.h>
+#include <debug.h>
+#include <string.h>
+
+/* Compressed format.
+
+   The output is a sequence of groups.  Each group begins with a
+   control byte whose bits, least significant first, describe the
+   up to 8 items that follow it.  A 0 bit is a literal byte,
+   copied to the output as is.  A 1 bit is a match, which repeats
+   earlier output:
+
+        byte 0: low 8 bits of (offset - 1)
+        byte 1: high 4 bits of (offset - 1), then length code
+        byte 2: only if the length code is 15, length - 18
+
+   A length code of 0...14 means a length of 3...17 bytes, so a
+   match is 3...273 bytes long and starts 1...4096 bytes back.  A
+   match may overlap the bytes it produces, which is how a run of
+   one repeated byte compresses to a few bytes. */
+
+#define MIN_MATCH 3                     /* Shortest match. */
+#define MAX_SHORT_MATCH (MIN_MATCH + 14) /* Longest 2-byte match. */
+#define MAX_MATCH (MAX_SHORT_MATCH + 1 + UINT8_MAX) /* Longest match. */
+#define MAX_OFFSET 4096                 /* Farthest match. */
+
+/* Returns the match table index for the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t x = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (x * 2654435761u) >> 22;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using TABLE for scratch space.  Returns the size of
+   the compressed data, or 0 if it would not fit in DST_SIZE
+   bytes.  SRC_SIZE must be less than 64 kB. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size,
+             uint16_t table[LZ_TABLE_SIZE])
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint8_t *out = dst;
+  uint8_t *out_end = dst + dst_size;
+  uint8_t *control = NULL;
+  size_t pos = 0;
+  int bit = 8;
+
+  ASSERT (src_size < UINT16_MAX);
+
+  /* Table entries hold a position plus 1, so that 0 is empty. */
+  memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+
+  while (pos < src_size)
+    {
+      size_t length = 0;
+      size_t offset = 0;
+
+      if (bit == 8)
+        {
+          if (out >= out_end)
+            return 0;
+          control = out++;
+          *control = 0;
+          bit = 0;
+        }
+
+      if (src_size - pos >= MIN_MATCH)
+        {
+          unsigned h = hash3 (src + pos);
+          size_t candidate = table[h];
+
+          table[h] = pos + 1;
+          if (candidate != 0 && pos - (candidate - 1) <= MAX_OFFSET)
+            {
+              size_t limit = src_size - pos;
+              candidate--;
+              if (limit > MAX_MATCH)
+                limit = MAX_MATCH;
+              while (length < limit
+                     && src[candidate + length] == src[pos + length])
+                length++;
+              offset = pos - candidate;
+            }
+        }
+
+      if (length >= MIN_MATCH)
+        {
+          size_t code = length <= MAX_SHORT_MATCH ? length - MIN_MATCH : 15;
+
+          if (out_end - out < (code == 15 ? 3 : 2))
+            return 0;
+          *out++ = (offset - 1) & 0xff;
+          *out++ = ((offset - 1) >> 8) | (code << 4);
+          if (code == 15)
+            *out++ = length - (MAX_SHORT_MATCH + 1);
+          *control |= 1 << bit;
+          pos += length;
+        }
+      else
+        {
+          if (out >= out_end)
+            return 0;
+          *out++ = src[pos++];
+        }
+      bit++;
+    }
+
+  return out - dst;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns the
+   number of bytes produced, or 0 if SRC is malformed or its data
+   does not fit in DST_SIZE bytes. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *in = src_;
+  const uint8_t *in_end = in + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *out = dst;
+  uint8_t *out_end = dst + dst_size;
+
+  while (in < in_end)
+    {
+      uint8_t control = *in++;
+      int bit;
+
+      for (bit = 0; bit < 8 && in < in_end; bit++)
+        if (control & (1 << bit))
+          {
+            size_t offset, length;
+
+            if (in_end - in < 2)
+              return 0;
+            offset = (in[0] | ((in[1] & 0x0f) << 8)) + 1;
+            length = (in[1] >> 4) + MIN_MATCH;
+            in += 2;
+            if (length > MAX_SHORT_MATCH)
+              {
+                if (in >= in_end)
+                  return 0;
+                length = *in++ + MAX_SHORT_MATCH + 1;
+              }
+            if (offset > (size_t) (out - dst)
+                || length > (size_t) (out_end - out))
+              return 0;
+            for (; length > 0; length--, out++)
+              *out = out[-offset];
+          }
+        else
+          {
+            if (out >= out_end)
+              return 0;
+            *out++ = *in++;
+          }
+    }
+
+  return out - dst;
+}
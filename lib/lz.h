@@ -0,0 +1,20 @@
+#ifndef __LIB_LZ_H
+#define __LIB_LZ_H
+
+/* A small, fast LZ77-style compressor for blocks of up to 64 kB.
+   It trades compression ratio for speed and needs no heap
+   memory: the caller supplies the match table. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of entries in the match table passed to lz_compress(). */
+#define LZ_TABLE_SIZE 1024
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size,
+                    uint16_t table[LZ_TABLE_SIZE]);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/lz.h */
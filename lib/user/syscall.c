@@ -141,6 +141,12 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+bool
+schedstat (struct schedstat *stats)
+{
+  return syscall1 (SYS_SCHEDSTAT, stats);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -153,6 +159,12 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+bool
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
 bool
 chdir (const char *dir)
 {
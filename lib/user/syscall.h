@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,6 +13,24 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Hints for madvise() about how a range of memory will be used. */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_SEQUENTIAL 1       /* Will be read in order, just once. */
+#define MADV_WILLNEED 2         /* Will be used soon. */
+#define MADV_DONTNEED 3         /* Contents are no longer needed. */
+
+/* Scheduler latency statistics written by schedstat(), in CPU
+   cycles.  latency[N] counts the wakeups, systemwide, that waited
+   from 2**N up to 2**(N+1) cycles to run (the first bucket also
+   counts shorter waits, the last also longer ones). */
+#define SCHEDSTAT_BUCKETS 32
+struct schedstat
+  {
+    uint64_t wait_cycles;       /* Time ready but not running. */
+    uint64_t block_cycles;      /* Time blocked. */
+    long long latency[SCHEDSTAT_BUCKETS];  /* Wakeup latency histogram. */
+  };
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -33,10 +52,12 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+bool schedstat (struct schedstat *);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+bool madvise (void *addr, unsigned length, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -0,0 +1,46 @@
+/* Runs with the timer in tickless mode.  Checks that timer_ticks()
+   counts every tick while a lone thread spins, even though the
+   timer does not interrupt on every tick, and that sleeping
+   threads wake on the tick they asked for. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SPIN_TICKS 50           /* Ticks to watch while spinning. */
+#define MAX_SLEEP 15            /* Longest sleep, in ticks. */
+
+void
+test_alarm_tickless (void)
+{
+  int64_t start, last, now;
+  int ticks;
+
+  msg ("spinning for %d ticks", SPIN_TICKS);
+  start = last = timer_ticks ();
+  while (last - start < SPIN_TICKS)
+    {
+      now = timer_ticks ();
+      if (now < last || now > last + 1)
+        fail ("timer_ticks() went from %lld to %lld",
+              (long long) last, (long long) now);
+      last = now;
+    }
+
+  msg ("sleeping for 1 to %d ticks", MAX_SLEEP);
+  for (ticks = 1; ticks <= MAX_SLEEP; ticks++)
+    {
+      int64_t elapsed;
+
+      start = timer_ticks ();
+      timer_sleep (ticks);
+      elapsed = timer_elapsed (start);
+      if (elapsed < ticks)
+        fail ("slept %lld ticks, asked for %d", (long long) elapsed, ticks);
+      if (elapsed > ticks + 1)
+        fail ("slept %lld ticks, asked for %d", (long long) elapsed, ticks);
+    }
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-tickless) begin
+(alarm-tickless) spinning for 50 ticks
+(alarm-tickless) sleeping for 1 to 15 ticks
+(alarm-tickless) PASS
+(alarm-tickless) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Allocates, checks, dirties, and frees batches of zeroed kernel
+   pages, first back to back and then with a short sleep between
+   batches so that the idle thread has a chance to refill the
+   reserve of pre-zeroed pages.  Every page handed out must be
+   all zeros, whichever way it was zeroed. */
+
+#include <stdint.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define BATCH 32
+#define ROUNDS 100
+
+static void run_batches (bool sleep);
+
+void
+test_palloc_prezero (void)
+{
+  msg ("allocating back to back");
+  run_batches (false);
+  msg ("allocating with idle time in between");
+  run_batches (true);
+  pass ();
+}
+
+static void
+run_batches (bool sleep)
+{
+  void *pages[BATCH];
+  int round;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      size_t i, j;
+
+      if (sleep)
+        timer_sleep (1);
+
+      for (i = 0; i < BATCH; i++)
+        {
+          pages[i] = palloc_get_page (PAL_ZERO);
+          if (pages[i] == NULL)
+            fail ("out of kernel pages in round %d", round);
+          for (j = 0; j < PGSIZE; j++)
+            if (((uint8_t *) pages[i])[j] != 0)
+              fail ("byte %zu of page %zu is not zero in round %d",
+                    j, i, round);
+        }
+
+      for (i = 0; i < BATCH; i++)
+        {
+          memset (pages[i], 0xa5, PGSIZE);
+          palloc_free_page (pages[i]);
+        }
+    }
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-prezero) begin
+(palloc-prezero) allocating back to back
+(palloc-prezero) allocating with idle time in between
+(palloc-prezero) PASS
+(palloc-prezero) end
+EOF
+pass;
@@ -0,0 +1,113 @@
+/* Measures the cost of an uncontended acquire and release of a
+   semaphore, a lock, and a reader-writer lock taken for reading
+   and for writing.  Then measures how long READER_CNT threads
+   take to each hold a lock for HOLD_TICKS timer ticks, first
+   with a lock and then with a reader-writer lock taken for
+   reading.  The readers should overlap only with the latter. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ITERATIONS 10000        /* Acquire/release pairs timed. */
+#define READER_CNT 4            /* Threads in the scalability run. */
+#define HOLD_TICKS 10           /* Ticks each one holds the lock. */
+
+static thread_func lock_reader, rwlock_reader;
+
+static struct semaphore sema;
+static struct lock lock;
+static struct rwlock rwlock;
+static struct semaphore done;
+
+void
+test_rwlock_bench (void)
+{
+  int64_t start_ticks, lock_ticks, rwlock_ticks;
+  uint64_t start;
+  int i;
+
+  sema_init (&sema, 1);
+  lock_init (&lock);
+  rwlock_init (&rwlock);
+  sema_init (&done, 0);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      sema_down (&sema);
+      sema_up (&sema);
+    }
+  msg ("semaphore: %"PRIu64" cycles", (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  msg ("lock: %"PRIu64" cycles", (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      rwlock_acquire_read (&rwlock);
+      rwlock_release_read (&rwlock);
+    }
+  msg ("rwlock read: %"PRIu64" cycles", (rdtsc () - start) / ITERATIONS);
+
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      rwlock_acquire_write (&rwlock);
+      rwlock_release_write (&rwlock);
+    }
+  msg ("rwlock write: %"PRIu64" cycles", (rdtsc () - start) / ITERATIONS);
+
+  start_ticks = timer_ticks ();
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("lock reader", PRI_DEFAULT, lock_reader, NULL);
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&done);
+  lock_ticks = timer_elapsed (start_ticks);
+  msg ("%d readers with a lock: %"PRId64" ticks", READER_CNT, lock_ticks);
+
+  start_ticks = timer_ticks ();
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("rwlock reader", PRI_DEFAULT, rwlock_reader, NULL);
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&done);
+  rwlock_ticks = timer_elapsed (start_ticks);
+  msg ("%d readers with an rwlock: %"PRId64" ticks",
+       READER_CNT, rwlock_ticks);
+
+  if (rwlock_ticks >= lock_ticks)
+    fail ("readers did not overlap");
+  pass ();
+}
+
+/* Holds `lock' for HOLD_TICKS ticks. */
+static void
+lock_reader (void *aux UNUSED)
+{
+  lock_acquire (&lock);
+  timer_sleep (HOLD_TICKS);
+  lock_release (&lock);
+  sema_up (&done);
+}
+
+/* Holds `rwlock' for reading for HOLD_TICKS ticks. */
+static void
+rwlock_reader (void *aux UNUSED)
+{
+  rwlock_acquire_read (&rwlock);
+  timer_sleep (HOLD_TICKS);
+  rwlock_release_read (&rwlock);
+  sema_up (&done);
+}
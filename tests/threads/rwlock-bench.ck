@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+
+# Cycle and tick counts vary from run to run.
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+s/\d+ (cycles|ticks)/N $1/ foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(rwlock-bench) begin
+(rwlock-bench) semaphore: N cycles
+(rwlock-bench) lock: N cycles
+(rwlock-bench) rwlock read: N cycles
+(rwlock-bench) rwlock write: N cycles
+(rwlock-bench) 4 readers with a lock: N ticks
+(rwlock-bench) 4 readers with an rwlock: N ticks
+(rwlock-bench) PASS
+(rwlock-bench) end
+EOF
+pass;
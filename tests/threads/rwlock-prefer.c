@@ -0,0 +1,50 @@
+/* Checks that a reader-writer lock prefers writers.  While the
+   main thread holds the lock for reading, a writer and then a
+   reader of the same, higher priority must wait, but a reader of
+   still higher priority gets in.  When the main thread releases
+   the lock, the writer must get it before the waiting reader. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader, writer;
+
+static struct rwlock rwlock;
+
+void
+test_rwlock_prefer (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock);
+  rwlock_acquire_read (&rwlock);
+  msg ("main holds read lock");
+
+  thread_create ("writer", PRI_DEFAULT + 1, writer, NULL);
+  thread_create ("reader", PRI_DEFAULT + 1, reader, NULL);
+  thread_create ("high reader", PRI_DEFAULT + 2, reader, NULL);
+
+  msg ("main releasing read lock");
+  rwlock_release_read (&rwlock);
+  msg ("main done");
+}
+
+static void
+reader (void *aux UNUSED)
+{
+  rwlock_acquire_read (&rwlock);
+  msg ("%s acquired read lock", thread_name ());
+  rwlock_release_read (&rwlock);
+}
+
+static void
+writer (void *aux UNUSED)
+{
+  rwlock_acquire_write (&rwlock);
+  msg ("%s acquired write lock", thread_name ());
+  rwlock_release_write (&rwlock);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-prefer) begin
+(rwlock-prefer) main holds read lock
+(rwlock-prefer) high reader acquired read lock
+(rwlock-prefer) main releasing read lock
+(rwlock-prefer) writer acquired write lock
+(rwlock-prefer) reader acquired read lock
+(rwlock-prefer) main done
+(rwlock-prefer) end
+EOF
+pass;
@@ -0,0 +1,82 @@
+/* Measures the cost of a thread_yield() that picks the running
+   thread again, first with a few lower-priority threads ready to
+   run and then with many of them spread over many priorities.
+   Choosing the next thread takes constant time, so the two
+   costs should be about the same; the test fails if the second
+   is more than SLOWDOWN_MAX times the first.  Then checks that
+   all the ready threads run once the main thread blocks. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define FEW_THREADS 5           /* Threads ready in the first run. */
+#define MANY_THREADS 200        /* Threads ready in the second run. */
+#define YIELD_CNT 10000         /* Yields timed in each run. */
+#define SLOWDOWN_MAX 2          /* Most the many-thread run may cost,
+                                   relative to the few-thread run. */
+
+static uint64_t measure (int thread_cnt);
+static thread_func finish;
+
+static struct semaphore finished;
+
+void
+test_sched_scale (void)
+{
+  uint64_t few_cycles, many_cycles;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&finished, 0);
+  few_cycles = measure (FEW_THREADS);
+  many_cycles = measure (MANY_THREADS);
+  if (many_cycles > few_cycles * SLOWDOWN_MAX)
+    fail ("yield with %d threads ready cost more than %d times "
+          "yield with %d", MANY_THREADS, SLOWDOWN_MAX, FEW_THREADS);
+  pass ();
+}
+
+/* Creates THREAD_CNT threads with priorities below ours, times
+   YIELD_CNT yields, then lets the threads run and exit.
+   Returns the cycles per yield. */
+static uint64_t
+measure (int thread_cnt)
+{
+  uint64_t start, cycles;
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[sizeof "ready -2147483648"];
+      snprintf (name, sizeof name, "ready %d", i);
+      if (thread_create (name, PRI_MIN + i % (PRI_DEFAULT - PRI_MIN),
+                         finish, NULL) == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  cycles = rdtsc () - start;
+  msg ("%d threads ready: %"PRIu64" cycles per yield", thread_cnt,
+       cycles / YIELD_CNT);
+
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&finished);
+  msg ("%d threads ran", thread_cnt);
+  return cycles / YIELD_CNT;
+}
+
+/* Ready thread.  Only runs once the main thread blocks. */
+static void
+finish (void *aux UNUSED)
+{
+  sema_up (&finished);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+
+# Cycle counts vary from run to run.
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+s/\d+ cycles/N cycles/ foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(sched-scale) begin
+(sched-scale) 5 threads ready: N cycles per yield
+(sched-scale) 5 threads ran
+(sched-scale) 200 threads ready: N cycles per yield
+(sched-scale) 200 threads ran
+(sched-scale) PASS
+(sched-scale) end
+EOF
+pass;
@@ -38,6 +38,14 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"palloc-prezero", test_palloc_prezero},
+    {"timer-wheel", test_timer_wheel},
+    {"sched-scale", test_sched_scale},
+    {"alarm-tickless", test_alarm_tickless},
+    {"thread-spawn", test_thread_spawn},
+    {"workqueue", test_workqueue},
+    {"rwlock-bench", test_rwlock_bench},
+    {"rwlock-prefer", test_rwlock_prefer},
   };
 
 static const char *test_name;
@@ -32,6 +32,14 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_palloc_prezero;
+extern test_func test_timer_wheel;
+extern test_func test_sched_scale;
+extern test_func test_alarm_tickless;
+extern test_func test_thread_spawn;
+extern test_func test_workqueue;
+extern test_func test_rwlock_bench;
+extern test_func test_rwlock_prefer;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,62 @@
+/* Creates 1,000 short-lived threads one after another and
+   reports the average cost of creating, running, and destroying
+   each.  Each thread has a higher priority than the main thread,
+   so it runs and exits before thread_create() returns, and its
+   page is free for the next one.  Threads that have exited leave
+   nothing behind that later ones must wade through, so the test
+   fails if the second half of the threads costs more than
+   SLOWDOWN_MAX times the first half. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+
+#define SPAWN_CNT 1000          /* Threads to create. */
+#define SLOWDOWN_MAX 2          /* Most the second half of the threads
+                                   may cost, relative to the first. */
+
+static thread_func worker;
+
+static int run_cnt;
+
+void
+test_thread_spawn (void)
+{
+  uint64_t start, half_cycles, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("spawning %d threads", SPAWN_CNT);
+  start = rdtsc ();
+  for (i = 0; i < SPAWN_CNT; i++)
+    {
+      if (i == SPAWN_CNT / 2)
+        half_cycles = rdtsc () - start;
+      if (thread_create ("worker", PRI_DEFAULT + 1, worker, NULL)
+          == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+  cycles = rdtsc () - start;
+
+  if (run_cnt != SPAWN_CNT)
+    fail ("only %d of %d threads ran", run_cnt, SPAWN_CNT);
+  msg ("%d threads ran, %"PRIu64" cycles each", SPAWN_CNT,
+       cycles / SPAWN_CNT);
+  if (cycles - half_cycles > half_cycles * SLOWDOWN_MAX)
+    fail ("spawning slowed down: %"PRIu64" cycles for the first half "
+          "of the threads, %"PRIu64" for the second",
+          half_cycles, cycles - half_cycles);
+  pass ();
+}
+
+/* Short-lived thread. */
+static void
+worker (void *aux UNUSED)
+{
+  run_cnt++;
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+
+# Cycle counts vary from run to run.
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+s/\d+ cycles/N cycles/ foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(thread-spawn) begin
+(thread-spawn) spawning 1000 threads
+(thread-spawn) 1000 threads ran, N cycles each
+(thread-spawn) PASS
+(thread-spawn) end
+EOF
+pass;
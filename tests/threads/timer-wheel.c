@@ -0,0 +1,109 @@
+/* Checks that timeouts fire on exactly the tick they were armed
+   for, across the boundary between the first two levels of the
+   timer wheel, and that cancelled timeouts never fire.  Then arms
+   and cancels 10,000 timeouts spread over a wide range of expiry
+   times and reports the average cost of each operation, all of
+   which is spent with interrupts off.  Arming a timeout takes
+   constant time however many are already pending, so the test
+   fails if arming the second half of them costs more than
+   SLOWDOWN_MAX times arming the first half. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CHECK_CNT 200           /* Timeouts that should fire. */
+#define CHECK_SPAN 300          /* Range of their delays, in ticks. */
+#define BENCH_CNT 10000         /* Timeouts armed and cancelled. */
+#define BENCH_SPAN 1000000      /* Range of their delays, in ticks. */
+#define SLOWDOWN_MAX 2          /* Most the second half of the arming
+                                   may cost, relative to the first. */
+
+/* A timeout and the tick at which it fired. */
+struct probe
+  {
+    struct timeout timeout;
+    int64_t fired;
+  };
+
+static void record_fire (void *);
+
+void
+test_timer_wheel (void)
+{
+  static struct probe probes[CHECK_CNT];
+  struct timeout *bench;
+  uint64_t start, half_cycles, arm_cycles, cancel_cnt, cancel_cycles;
+  int i;
+
+  msg ("arming %d timeouts", CHECK_CNT);
+  for (i = 0; i < CHECK_CNT; i++)
+    {
+      probes[i].fired = -1;
+      timeout_init (&probes[i].timeout, record_fire, &probes[i]);
+      timeout_add (&probes[i].timeout, 1 + random_ulong () % CHECK_SPAN);
+    }
+  for (i = 0; i < CHECK_CNT; i += 4)
+    if (!timeout_cancel (&probes[i].timeout))
+      fail ("timeout %d was not pending", i);
+
+  timer_sleep (CHECK_SPAN + 2);
+  for (i = 0; i < CHECK_CNT; i++)
+    if (i % 4 == 0 && probes[i].fired != -1)
+      fail ("cancelled timeout %d fired", i);
+    else if (i % 4 != 0 && probes[i].fired != probes[i].timeout.expires)
+      fail ("timeout %d fired at tick %"PRId64", expected %"PRId64,
+            i, probes[i].fired, probes[i].timeout.expires);
+  msg ("every timeout fired on time");
+
+  bench = malloc (BENCH_CNT * sizeof *bench);
+  if (bench == NULL)
+    fail ("out of memory");
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    {
+      if (i == BENCH_CNT / 2)
+        half_cycles = rdtsc () - start;
+      timeout_init (&bench[i], record_fire, NULL);
+      timeout_add (&bench[i], 1 + random_ulong () % BENCH_SPAN);
+    }
+  arm_cycles = rdtsc () - start;
+
+  cancel_cnt = 0;
+  start = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    cancel_cnt += timeout_cancel (&bench[i]);
+  cancel_cycles = rdtsc () - start;
+  free (bench);
+
+  if (cancel_cnt != BENCH_CNT)
+    fail ("only %"PRIu64" of %d timeouts were still pending",
+          cancel_cnt, BENCH_CNT);
+  msg ("armed %d timeouts, %"PRIu64" cycles each", BENCH_CNT,
+       arm_cycles / BENCH_CNT);
+  msg ("cancelled %d timeouts, %"PRIu64" cycles each", BENCH_CNT,
+       cancel_cycles / BENCH_CNT);
+  if (arm_cycles - half_cycles > half_cycles * SLOWDOWN_MAX)
+    fail ("arming slowed down as timeouts piled up: "
+          "%"PRIu64" cycles for the first half, %"PRIu64" for the second",
+          half_cycles, arm_cycles - half_cycles);
+  pass ();
+}
+
+/* Records the tick at which the probe AUX fired.  Benchmark
+   timeouts have no probe, and should never fire. */
+static void
+record_fire (void *aux)
+{
+  struct probe *p = aux;
+
+  if (p == NULL)
+    fail ("benchmark timeout fired");
+  p->fired = timer_ticks ();
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+
+# Cycle counts vary from run to run.
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+s/\d+ cycles/N cycles/ foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(timer-wheel) begin
+(timer-wheel) arming 200 timeouts
+(timer-wheel) every timeout fired on time
+(timer-wheel) armed 10000 timeouts, N cycles each
+(timer-wheel) cancelled 10000 timeouts, N cycles each
+(timer-wheel) PASS
+(timer-wheel) end
+EOF
+pass;
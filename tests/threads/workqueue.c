@@ -0,0 +1,71 @@
+/* Exercises the system workqueue: queues a burst of work items,
+   checks that queueing a pending item again does nothing, and
+   flushes them all; then checks that delayed work runs no
+   earlier than asked, and that flush_work() waits for it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define WORK_CNT 100            /* Items in the burst. */
+#define DELAY 10                /* Delay for delayed work, in ticks. */
+
+static work_func count_run;
+static work_func record_tick;
+
+static int run_cnt[WORK_CNT];
+
+void
+test_workqueue (void)
+{
+  static struct work works[WORK_CNT];
+  struct work delayed;
+  int64_t start, ran = -1;
+  int i;
+
+  msg ("queueing %d items", WORK_CNT);
+  for (i = 0; i < WORK_CNT; i++)
+    {
+      work_init (&works[i], count_run, &run_cnt[i]);
+      if (!queue_work (system_wq, &works[i]))
+        fail ("item %d was already pending", i);
+      queue_work (system_wq, &works[i]);
+    }
+  for (i = 0; i < WORK_CNT; i++)
+    flush_work (&works[i]);
+  for (i = 0; i < WORK_CNT; i++)
+    if (run_cnt[i] != 1 && run_cnt[i] != 2)
+      fail ("item %d ran %d times", i, run_cnt[i]);
+  msg ("every item ran");
+
+  msg ("queueing an item %d ticks ahead", DELAY);
+  work_init (&delayed, record_tick, &ran);
+  start = timer_ticks ();
+  queue_delayed_work (system_wq, &delayed, DELAY);
+  flush_work (&delayed);
+  if (ran < 0)
+    fail ("flush_work() returned before the item ran");
+  if (ran < start + DELAY)
+    fail ("item ran after %lld ticks", (long long) (ran - start));
+  msg ("delayed item ran on time");
+  pass ();
+}
+
+/* Counts a run of the item whose counter is AUX. */
+static void
+count_run (void *aux)
+{
+  int *cnt = aux;
+  (*cnt)++;
+}
+
+/* Records the tick at which it runs in *AUX. */
+static void
+record_tick (void *aux)
+{
+  int64_t *tick = aux;
+  *tick = timer_ticks ();
+}
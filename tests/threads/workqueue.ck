@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) queueing 100 items
+(workqueue) every item ran
+(workqueue) queueing an item 10 ticks ahead
+(workqueue) delayed item ran on time
+(workqueue) PASS
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,25 @@
+/* Checks that schedstat() reports the process's time waiting for
+   the CPU and a wakeup latency histogram that has recorded at
+   least this process's first wakeup, then that a bad pointer
+   kills the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct schedstat stats;
+  long long wakeup_cnt = 0;
+  int i;
+
+  CHECK (schedstat (&stats), "schedstat");
+  for (i = 0; i < SCHEDSTAT_BUCKETS; i++)
+    wakeup_cnt += stats.latency[i];
+  CHECK (wakeup_cnt > 0, "wakeups recorded");
+  CHECK (stats.wait_cycles > 0, "wait time recorded");
+
+  schedstat ((struct schedstat *) 0xc0000000);
+  fail ("should have exited with -1");
+}
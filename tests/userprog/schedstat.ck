@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(schedstat) begin
+(schedstat) schedstat
+(schedstat) wakeups recorded
+(schedstat) wait time recorded
+schedstat: exit(-1)
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Child process of page-ksm.
+   Fills 64 pages with data that is the same in every instance,
+   reads them back many times to give identical pages a chance to
+   be merged, then writes every fourth page and checks that only
+   those pages changed. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-ksm";
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+#define ROUNDS 200
+
+static unsigned char pages[PAGE_CNT][PAGE_SIZE];
+
+/* Returns the byte that belongs at offset OFS of page PAGE. */
+static unsigned char
+pattern (size_t page, size_t ofs)
+{
+  return page * 7 + ofs / 64;
+}
+
+int
+main (void)
+{
+  size_t round, i, j;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    for (j = 0; j < PAGE_SIZE; j++)
+      pages[i][j] = pattern (i, j);
+
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < PAGE_CNT; i++)
+      for (j = 0; j < PAGE_SIZE; j += 64)
+        if (pages[i][j] != pattern (i, j))
+          fail ("page %zu byte %zu changed in round %zu", i, j, round);
+
+  for (i = 0; i < PAGE_CNT; i += 4)
+    pages[i][0] = ~pattern (i, 0);
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      unsigned char expected = i % 4 == 0 ? ~pattern (i, 0) : pattern (i, 0);
+      if (pages[i][0] != expected)
+        fail ("page %zu is %d, should be %d", i, pages[i][0], expected);
+    }
+
+  return 0x42;
+}
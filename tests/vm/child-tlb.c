@@ -0,0 +1,30 @@
+/* Child process of tlb-switch.
+   Sweeps a word in each of 64 pages many times over, then checks
+   that every page was updated the right number of times. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-tlb";
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+#define ROUNDS 20000
+
+static int pages[PAGE_CNT][PAGE_SIZE / sizeof (int)];
+
+int
+main (void)
+{
+  size_t round, i;
+
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < PAGE_CNT; i++)
+      pages[i][0]++;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (pages[i][0] != ROUNDS)
+      fail ("page %zu is %d, should be %d", i, pages[i][0], ROUNDS);
+
+  return 0x42;
+}
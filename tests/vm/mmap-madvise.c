@@ -0,0 +1,67 @@
+/* Gives each madvise() hint for a memory-mapped file and for
+   ordinary memory and checks that memory still reads back as it
+   should.  The file's Nth 32-bit word holds N in big-endian byte
+   order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define PAGE_SIZE 4096
+
+static char buf[16 * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Checks every word of the mapping at BASE. */
+static void
+check_words (const unsigned char *base)
+{
+  size_t i;
+
+  for (i = 0; i < FILE_SIZE / 4; i++)
+    {
+      const unsigned char *w = base + i * 4;
+      size_t value = ((size_t) w[0] << 24) | (w[1] << 16) | (w[2] << 8) | w[3];
+      if (value != i)
+        fail ("word %zu of mmap'd file is %zu", i, value);
+    }
+}
+
+void
+test_main (void)
+{
+  unsigned char *base = (unsigned char *) 0x10000000;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("words")) > 1, "open \"words\"");
+  CHECK ((map = mmap (handle, base)) != MAP_FAILED, "mmap \"words\"");
+
+  CHECK (madvise (base, FILE_SIZE, MADV_WILLNEED), "madvise WILLNEED");
+  CHECK (madvise (base, FILE_SIZE, MADV_SEQUENTIAL), "madvise SEQUENTIAL");
+  msg ("scan");
+  check_words (base);
+
+  CHECK (madvise (base, FILE_SIZE, MADV_DONTNEED), "madvise DONTNEED");
+  CHECK (madvise (base, FILE_SIZE, MADV_NORMAL), "madvise NORMAL");
+  msg ("scan again");
+  check_words (base);
+
+  munmap (map);
+  close (handle);
+
+  /* Ordinary memory reads back as zeros after MADV_DONTNEED. */
+  memset (buf, 0xa5, sizeof buf);
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED), "madvise DONTNEED buf");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu of discarded memory is %02hhx", i, buf[i]);
+
+  /* Bad arguments. */
+  CHECK (!madvise (buf + 1, PAGE_SIZE, MADV_NORMAL), "misaligned madvise");
+  CHECK (!madvise (buf, PAGE_SIZE, 99), "unknown advice");
+  CHECK (!madvise ((void *) 0xbffff000, 2 * PAGE_SIZE, MADV_WILLNEED),
+         "madvise into kernel space");
+}
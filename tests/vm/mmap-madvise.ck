@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) open "words"
+(mmap-madvise) mmap "words"
+(mmap-madvise) madvise WILLNEED
+(mmap-madvise) madvise SEQUENTIAL
+(mmap-madvise) scan
+(mmap-madvise) madvise DONTNEED
+(mmap-madvise) madvise NORMAL
+(mmap-madvise) scan again
+(mmap-madvise) madvise DONTNEED buf
+(mmap-madvise) misaligned madvise
+(mmap-madvise) unknown advice
+(mmap-madvise) madvise into kernel space
+(mmap-madvise) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Scans a 256 kB file sequentially through a memory mapping and
+   checks every word of it.  The file's Nth 32-bit word holds N in
+   big-endian byte order.
+
+   Reading ahead should let this take far fewer page faults than
+   there are pages in the file: compare the page fault count
+   printed at shutdown. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+
+void
+test_main (void)
+{
+  const unsigned char *base = (const unsigned char *) 0x10000000;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("words")) > 1, "open \"words\"");
+  CHECK ((map = mmap (handle, (void *) base)) != MAP_FAILED,
+         "mmap \"words\"");
+
+  msg ("scan");
+  for (i = 0; i < FILE_SIZE / 4; i++)
+    {
+      const unsigned char *w = base + i * 4;
+      size_t value = ((size_t) w[0] << 24) | (w[1] << 16) | (w[2] << 8) | w[3];
+      if (value != i)
+        fail ("word %zu of mmap'd file is %zu", i, value);
+    }
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-scan) begin
+(mmap-scan) open "words"
+(mmap-scan) mmap "words"
+(mmap-scan) scan
+(mmap-scan) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Fills 2 MB of memory, more than fits in RAM, with pages of
+   easily compressed data that differs from page to page, then
+   verifies it twice, forcing the pages through swap.  The data
+   should fit in the compressed swap cache. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define RECORD 32
+
+static char buf[SIZE];
+
+/* Fills the page at P, page number N, with its pattern. */
+static void
+fill_page (char *p, size_t n)
+{
+  size_t i;
+
+  memset (p, 0, RECORD);
+  snprintf (p, RECORD, "page %zu", n);
+  for (i = RECORD; i < PAGE_SIZE; i++)
+    p[i] = p[i % RECORD];
+}
+
+/* Checks the page at P, page number N. */
+static void
+check_page (const char *p, size_t n)
+{
+  char expected[PAGE_SIZE];
+
+  fill_page (expected, n);
+  if (memcmp (p, expected, PAGE_SIZE))
+    fail ("page %zu corrupted", n);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("initialize");
+  for (i = 0; i < SIZE / PAGE_SIZE; i++)
+    fill_page (buf + i * PAGE_SIZE, i);
+
+  msg ("read pass forward");
+  for (i = 0; i < SIZE / PAGE_SIZE; i++)
+    check_page (buf + i * PAGE_SIZE, i);
+
+  msg ("read pass backward");
+  for (i = SIZE / PAGE_SIZE; i-- > 0; )
+    check_page (buf + i * PAGE_SIZE, i);
+}
@@ -0,0 +1,50 @@
+/* Repeatedly touches a small "hot" set of pages in between
+   sweeps through a "cold" array too big to fit in memory, then
+   verifies the contents of both.
+
+   A replacement policy that notices recent use keeps the hot
+   pages resident, so this doubles as a benchmark: compare the
+   page fault counts printed at shutdown when the kernel is run
+   with -evict=fifo, -evict=clock, and -evict=aging. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define COLD_PAGES 512
+#define HOT_PAGES 32
+#define ROUNDS 8
+
+static unsigned char cold[COLD_PAGES * PAGE_SIZE];
+static unsigned char hot[HOT_PAGES * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  size_t round, i, j;
+
+  msg ("initialize");
+  memset (hot, 0, sizeof hot);
+  for (i = 0; i < COLD_PAGES; i++)
+    cold[i * PAGE_SIZE] = i;
+
+  msg ("mixed passes");
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < COLD_PAGES; i++)
+      {
+        cold[i * PAGE_SIZE]++;
+        for (j = 0; j < HOT_PAGES; j++)
+          hot[j * PAGE_SIZE]++;
+      }
+
+  msg ("check");
+  for (i = 0; i < COLD_PAGES; i++)
+    if (cold[i * PAGE_SIZE] != (unsigned char) (i + ROUNDS))
+      fail ("cold page %zu is %d, should be %d",
+            i, cold[i * PAGE_SIZE], (unsigned char) (i + ROUNDS));
+  for (j = 0; j < HOT_PAGES; j++)
+    if (hot[j * PAGE_SIZE] != (unsigned char) (ROUNDS * COLD_PAGES))
+      fail ("hot page %zu is %d, should be %d",
+            j, hot[j * PAGE_SIZE], (unsigned char) (ROUNDS * COLD_PAGES));
+}
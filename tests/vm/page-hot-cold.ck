@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-hot-cold) begin
+(page-hot-cold) initialize
+(page-hot-cold) mixed passes
+(page-hot-cold) check
+(page-hot-cold) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Sweeps an array that is aligned to 4 MB, which asks the loader
+   to back it with a 4 MB page, touching one word in every 4 kB
+   page over and over, then verifies the array's contents.
+
+   This doubles as a benchmark: with 4 kB pages every page of the
+   sweep needs its own TLB entry, but one 4 MB page covers them
+   all.  The TLB line printed at shutdown says whether a 4 MB
+   page was used, and the timer line how long the sweeps took.
+   The kernel falls back to 4 kB pages when it can't find a free
+   4 MB-aligned run of memory. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ARRAY_SIZE (4 * 1024 * 1024)
+#define PAGE_CNT (ARRAY_SIZE / PAGE_SIZE)
+#define ROUNDS 200
+
+static int big[ARRAY_SIZE / sizeof (int)]
+  __attribute__ ((aligned (ARRAY_SIZE)));
+
+void
+test_main (void)
+{
+  size_t round, i;
+
+  msg ("sweep");
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < PAGE_CNT; i++)
+      big[i * (PAGE_SIZE / sizeof (int)) + round % 16]++;
+
+  msg ("check");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      size_t j;
+
+      for (j = 0; j < 16; j++)
+        {
+          int expected = ROUNDS / 16 + (j < ROUNDS % 16);
+          int actual = big[i * (PAGE_SIZE / sizeof (int)) + j];
+          if (actual != expected)
+            fail ("word %zu of page %zu is %d, should be %d",
+                  j, i, actual, expected);
+        }
+    }
+}
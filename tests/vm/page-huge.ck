@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-huge) begin
+(page-huge) sweep
+(page-huge) check
+(page-huge) end
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Runs 4 child-ksm processes at once.  Each fills the same data
+   into an array, reads it over and over, and then writes part of
+   it.
+
+   This doubles as a benchmark: run with -ksm, the KSM line
+   printed at shutdown shows how many user pool frames the
+   merging thread reclaimed, and how quickly. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK ((children[i] = exec ("child-ksm")) != -1,
+           "exec \"child-ksm\"");
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
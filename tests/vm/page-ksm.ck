@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-ksm) begin
+(page-ksm) exec "child-ksm"
+(page-ksm) exec "child-ksm"
+(page-ksm) exec "child-ksm"
+(page-ksm) exec "child-ksm"
+(page-ksm) wait for child 0
+(page-ksm) wait for child 1
+(page-ksm) wait for child 2
+(page-ksm) wait for child 3
+(page-ksm) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Reads every page of a static array much bigger than physical
+   memory and swap combined, which only works if untouched pages
+   share a single zero page, then writes to a few of them and
+   checks that the rest still read as zero. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 2048
+#define STRIDE 97
+
+static char sparse[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("read every page");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (sparse[i * PAGE_SIZE + i % PAGE_SIZE] != 0)
+      fail ("page %zu is not zero", i);
+
+  msg ("write some pages");
+  for (i = 0; i < PAGE_CNT; i += STRIDE)
+    memset (sparse + i * PAGE_SIZE, i % 255 + 1, PAGE_SIZE);
+
+  msg ("check");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      char expected = i % STRIDE == 0 ? i % 255 + 1 : 0;
+      if (sparse[i * PAGE_SIZE + PAGE_SIZE - 1] != expected)
+        fail ("page %zu is %d, should be %d",
+              i, sparse[i * PAGE_SIZE + PAGE_SIZE - 1], expected);
+    }
+}
@@ -0,0 +1,27 @@
+/* Runs 4 child-tlb processes at once, so that the scheduler
+   switches page directories between processes that each keep
+   sweeping a working set of pages.
+
+   This doubles as a benchmark: the TLB line printed at shutdown
+   counts full TLB flushes and single-page invalidations, and the
+   timer line shows how long the sweeps took. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK ((children[i] = exec ("child-tlb")) != -1,
+           "exec \"child-tlb\"");
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
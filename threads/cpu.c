@@ -0,0 +1,512 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/spinlock.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor support.
+
+   The bootstrap processor (BSP) boots the kernel.  If the BIOS's
+   MP configuration table lists other CPUs, the application
+   processors (APs), then cpu_init() maps the local APICs and
+   cpu_start_aps() starts the APs, each one on the thread that
+   becomes its idle thread.  From then on each CPU runs threads
+   from its own ready queues, and a CPU that runs out takes
+   threads from the others' queues.  See thread.c.
+
+   Refer to [MP] for the MP configuration table and [IA32-v3a]
+   "Multiple-Processor (MP) Initialization" for starting the APs.
+
+   Devices, including the timer, interrupt only the BSP.  The BSP
+   passes each timer tick on to the APs as an IPI, so that they
+   can time-slice too. */
+
+/* The CPUs. */
+struct cpu cpus[CPU_MAX];
+unsigned cpu_cnt = 1;
+bool cpu_smp;
+
+/* -cpus: Most CPUs to use. */
+static unsigned cpu_limit = CPU_MAX;
+
+/* IPI vectors. */
+#define IPI_TICK (LAPIC_VEC_MIN + 0)    /* Timer tick from the BSP. */
+#define IPI_KICK (LAPIC_VEC_MIN + 1)    /* A thread is ready here. */
+#define IPI_FLUSH (LAPIC_VEC_MIN + 2)   /* Flush the TLB. */
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fps
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units, i.e. 1. */
+    uint8_t version;            /* MP specification version. */
+    uint8_t checksum;           /* Makes all the bytes sum to 0. */
+    uint8_t features[5];        /* Feature information. */
+  };
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table, with header. */
+    uint8_t version;            /* MP specification version. */
+    uint8_t checksum;           /* Makes all the bytes sum to 0. */
+    char oem_id[8];             /* Manufacturer. */
+    char product_id[12];        /* Product family. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_table_size;    /* Size of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries that follow. */
+    uint32_t lapic;             /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Length of extended entries. */
+    uint8_t ext_checksum;       /* Checksum of extended entries. */
+    uint8_t reserved;
+  };
+
+/* MP configuration table processor entry.  See [MP] 4.3.1.
+   Entries of other types are 8 bytes long. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MP_CPU_* flags. */
+    uint32_t signature;         /* Stepping, model, family. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  };
+
+#define MP_PROCESSOR 0          /* Processor entry type. */
+#define MP_OTHER_SIZE 8         /* Size of other entries. */
+#define MP_CPU_ENABLED 0x01     /* Usable. */
+
+/* Stack for the AP being started, read by ap_start in start.S. */
+uint8_t *ap_stack;
+
+/* CR4 of the BSP, which the APs copy. */
+static uint32_t bsp_cr4;
+
+/* Serializes an AP's arrival against the BSP giving up on it. */
+static struct spinlock start_lock;
+
+static struct mp_config *find_config (void);
+static struct mp_fps *search (uintptr_t paddr, size_t size);
+static uint8_t sum (const void *, size_t);
+static void start_ap (struct cpu *);
+static intr_handler_func tick_interrupt, kick_interrupt, flush_interrupt;
+static intr_handler_func spurious_interrupt;
+
+/* Uses at most N CPUs, for the -cpus option. */
+void
+cpu_set_limit (unsigned n)
+{
+  ASSERT (n > 0);
+  cpu_limit = n < CPU_MAX ? n : CPU_MAX;
+}
+
+/* Finds the CPUs listed in the MP configuration table, if there
+   is one, and maps the local APICs.  The BSP becomes cpus[0].
+   Must be called after paging_init() and before any process is
+   created or tss_init() is called.
+
+   Unless more than one usable CPU is found, leaves the kernel
+   uniprocessor, without touching the local APIC. */
+void
+cpu_init (void)
+{
+  struct mp_config *config;
+  uint8_t *entry;
+  uint8_t bsp_id;
+  unsigned usable_cnt, i;
+
+  cpus[0].state = CPU_RUNNING;
+  if (cpu_limit < 2)
+    return;
+
+  config = find_config ();
+  if (config == NULL)
+    return;
+
+  /* Count the usable CPUs. */
+  usable_cnt = 0;
+  entry = (uint8_t *) (config + 1);
+  for (i = 0; i < config->entry_cnt; i++)
+    if (*entry == MP_PROCESSOR)
+      {
+        struct mp_processor *p = (struct mp_processor *) entry;
+        if (p->flags & MP_CPU_ENABLED)
+          usable_cnt++;
+        entry += sizeof *p;
+      }
+    else
+      entry += MP_OTHER_SIZE;
+  if (usable_cnt < 2 || !lapic_map (config->lapic))
+    return;
+
+  /* Record the BSP, then the others up to the limit. */
+  bsp_id = lapic_id ();
+  cpus[0].apic_id = bsp_id;
+  entry = (uint8_t *) (config + 1);
+  for (i = 0; i < config->entry_cnt && cpu_cnt < cpu_limit; i++)
+    if (*entry == MP_PROCESSOR)
+      {
+        struct mp_processor *p = (struct mp_processor *) entry;
+        if ((p->flags & MP_CPU_ENABLED) && p->apic_id != bsp_id)
+          {
+            cpus[cpu_cnt].id = cpu_cnt;
+            cpus[cpu_cnt].apic_id = p->apic_id;
+            cpu_cnt++;
+          }
+        entry += sizeof *p;
+      }
+    else
+      entry += MP_OTHER_SIZE;
+}
+
+/* Starts the APs that cpu_init() found.  Must be called from a
+   thread with interrupts on, after timer_calibrate(). */
+void
+cpu_start_aps (void)
+{
+  unsigned running_cnt, i;
+
+  if (cpu_cnt < 2)
+    return;
+  ASSERT (intr_get_level () == INTR_ON);
+
+  intr_register_ext (IPI_TICK, tick_interrupt, "IPI Timer Tick");
+  intr_register_ext (IPI_KICK, kick_interrupt, "IPI Reschedule");
+  intr_register_ext (IPI_FLUSH, flush_interrupt, "IPI TLB Flush");
+  intr_register_ext (LAPIC_SPURIOUS, spurious_interrupt,
+                     "APIC Spurious");
+  lapic_init (true);
+
+  /* The APs time-slice on ticks passed on by the BSP, so the BSP
+     must not skip any.  Sleeping a tick waits out any stretch of
+     skipped ticks already under way. */
+  timer_set_tickless (false);
+  timer_sleep (1);
+
+  asm volatile ("movl %%cr4, %0" : "=r" (bsp_cr4));
+  spinlock_init (&start_lock);
+  cpu_smp = true;
+
+  /* Stop at the first AP that fails to start, because it might
+     still arrive late, on the stack meant for the next one. */
+  running_cnt = 1;
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      start_ap (&cpus[i]);
+      if (cpus[i].state != CPU_RUNNING)
+        break;
+      running_cnt++;
+    }
+  printf ("%u of %u CPUs running.\n", running_cnt, cpu_cnt);
+}
+
+/* Starts AP C and waits up to about 100 ms for it to arrive in
+   ap_main(). */
+static void
+start_ap (struct cpu *c)
+{
+  extern char ap_start[];
+  enum intr_level old_level;
+  struct thread *t;
+  int ms;
+
+  t = thread_create_ap (c);
+  if (t == NULL)
+    return;
+  ap_stack = (uint8_t *) t + PGSIZE;
+  c->state = CPU_STARTING;
+  lapic_start_ap (c->apic_id, vtop (ap_start));
+
+  for (ms = 0; ms < 100 && c->state == CPU_STARTING; ms++)
+    timer_msleep (1);
+
+  old_level = spinlock_acquire (&start_lock);
+  if (c->state == CPU_STARTING)
+    {
+      c->state = CPU_FAILED;
+      printf ("CPU %u (APIC ID %u) did not start.\n",
+              c->id, c->apic_id);
+    }
+  spinlock_release (&start_lock, old_level);
+}
+
+/* Called by ap_start in start.S, on an AP, on the stack of the
+   thread that thread_create_ap() made for it.  Finishes setting
+   up the CPU, then runs its idle thread. */
+void
+ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+  enum intr_level old_level;
+  bool arrived;
+
+  /* Switch from start.S's page directory to the kernel's, with
+     the paging features that paging_init() turned on for the
+     BSP. */
+  asm volatile ("movl %0, %%cr4" : : "r" (bsp_cr4));
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir))
+                : "memory");
+
+  intr_init_ap ();
+#ifdef USERPROG
+  gdt_load ();
+#endif
+  lapic_init (false);
+
+  old_level = spinlock_acquire (&start_lock);
+  arrived = c->state == CPU_STARTING;
+  if (arrived)
+    c->state = CPU_RUNNING;
+  spinlock_release (&start_lock, old_level);
+
+  /* Too late: the BSP gave up on us. */
+  if (!arrived)
+    for (;;)
+      asm volatile ("cli; hlt");
+
+  thread_start_ap ();
+}
+
+/* Returns the running CPU.  Unless interrupts are off, the
+   running thread may move to another CPU at any time, making the
+   answer out of date. */
+struct cpu *
+cpu_current (void)
+{
+  uint32_t *esp;
+
+  if (!cpu_smp)
+    return &cpus[0];
+
+  /* The running thread's struct thread is at the start of the
+     page that holds its stack, as in running_thread(), and
+     records the CPU it runs on. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return ((struct thread *) pg_round_down (esp))->cpu;
+}
+
+/* Has CPU C look at its ready queues, because a thread there may
+   now have priority over its running thread. */
+void
+cpu_kick (struct cpu *c)
+{
+  if (cpu_smp && c != cpu_current () && c->state == CPU_RUNNING)
+    lapic_send_ipi (c->apic_id, IPI_KICK);
+}
+
+/* Passes a timer tick on to the APs.  Called by the BSP from the
+   timer interrupt. */
+void
+cpu_tick_others (void)
+{
+  unsigned i;
+
+  for (i = 1; i < cpu_cnt; i++)
+    if (cpus[i].state == CPU_RUNNING)
+      lapic_send_ipi (cpus[i].apic_id, IPI_TICK);
+}
+
+/* Atomically increments *P and returns the new value. */
+static inline unsigned
+atomic_inc (volatile unsigned *p)
+{
+  unsigned value = 1;
+  asm volatile ("lock xaddl %0, %1" : "+r" (value), "+m" (*p)
+                : : "memory");
+  return value + 1;
+}
+
+/* Returns true if one of the PD_CNT page directories in PDS is
+   PD. */
+static bool
+pd_in (uint32_t *pd, uint32_t *const pds[], size_t pd_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < pd_cnt; i++)
+    if (pds[i] == pd)
+      return true;
+  return false;
+}
+
+/* Makes the other CPUs on which any of the PD_CNT page
+   directories in PDS is active flush their TLBs, after entries in
+   them were changed, and waits until they have.  One IPI to each
+   CPU covers all of PDS.  The caller flushes its own TLB.
+
+   May be called with interrupts off.  While it waits, it does
+   the flushes that other CPUs ask of this one, so that two CPUs
+   flushing at once do not wait for each other forever. */
+void
+cpu_flush_tlbs (uint32_t *const pds[], size_t pd_cnt)
+{
+  struct cpu *targets[CPU_MAX];
+  unsigned wanted[CPU_MAX];
+  size_t target_cnt, i;
+  enum intr_level old_level;
+  struct cpu *self;
+
+  if (!cpu_smp || pd_cnt == 0)
+    return;
+
+  /* Stay on one CPU throughout.  A CPU that makes one of PDS
+     active after we look reloads CR3, which flushes its TLB
+     anyway. */
+  target_cnt = 0;
+  old_level = intr_disable_local ();
+  self = cpu_current ();
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      if (c != self && c->state == CPU_RUNNING
+          && pd_in (c->pagedir, pds, pd_cnt))
+        {
+          targets[target_cnt] = c;
+          wanted[target_cnt] = atomic_inc (&c->flush_req);
+          lapic_send_ipi (c->apic_id, IPI_FLUSH);
+          target_cnt++;
+        }
+    }
+
+  for (i = 0; i < target_cnt; i++)
+    while ((int) (targets[i]->flush_done - wanted[i]) < 0)
+      {
+        cpu_flush_pending ();
+        asm volatile ("pause");
+      }
+  intr_set_level_local (old_level);
+}
+
+/* Flushes this CPU's TLB if other CPUs have asked it to since it
+   last did.  Interrupts must be off.  Besides the flush IPI's
+   handler, code that spins with interrupts off calls this, since
+   the CPU it waits for may itself be waiting in cpu_flush_tlbs()
+   for this one to flush. */
+void
+cpu_flush_pending (void)
+{
+  struct cpu *c;
+  unsigned req;
+  uint32_t cr3;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!cpu_smp)
+    return;
+
+  /* All requests made before we read flush_req are covered by the
+     flush; those made after sent another IPI. */
+  c = cpu_current ();
+  req = c->flush_req;
+  if (req == c->flush_done)
+    return;
+  asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r" (cr3)
+                : : "memory");
+  c->flush_done = req;
+}
+
+/* Finds the MP configuration table, and returns it if it is
+   well-formed or a null pointer otherwise. */
+static struct mp_config *
+find_config (void)
+{
+  /* The floating pointer structure is in the first kB of the
+     extended BIOS data area, whose segment is in the BIOS data
+     area, or else in the last kB of base memory, or else in the
+     BIOS ROM.  See [MP] 4. */
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fps *fps = NULL;
+  struct mp_config *config;
+
+  if (ebda_seg != 0)
+    fps = search ((uintptr_t) ebda_seg << 4, 1024);
+  if (fps == NULL)
+    fps = search (base_kb * 1024 - 1024, 1024);
+  if (fps == NULL)
+    fps = search (0xf0000, 0x10000);
+
+  /* A configuration table address of 0 means one of the default
+     configurations, which have only two CPUs and which we do not
+     bother with. */
+  if (fps == NULL || fps->config == 0
+      || fps->config >= init_ram_pages * PGSIZE)
+    return NULL;
+
+  config = ptov (fps->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || fps->config + config->length > init_ram_pages * PGSIZE
+      || sum (config, config->length) != 0)
+    return NULL;
+  return config;
+}
+
+/* Searches SIZE bytes at physical address PADDR for an MP
+   floating pointer structure, which lies on a 16-byte boundary.
+   Returns it if found or a null pointer otherwise. */
+static struct mp_fps *
+search (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fps) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && sum (p, sizeof (struct mp_fps)) == 0)
+      return (struct mp_fps *) p;
+  return NULL;
+}
+
+/* Returns the sum of the SIZE bytes in BLOCK, modulo 256. */
+static uint8_t
+sum (const void *block, size_t size)
+{
+  const uint8_t *p = block;
+  uint8_t s = 0;
+
+  while (size-- > 0)
+    s += *p++;
+  return s;
+}
+
+/* Timer tick passed on by the BSP. */
+static void
+tick_interrupt (struct intr_frame *f UNUSED)
+{
+  thread_tick ();
+}
+
+/* Another CPU made a thread ready on this one. */
+static void
+kick_interrupt (struct intr_frame *f UNUSED)
+{
+  thread_preempt ();
+}
+
+/* Another CPU changed an entry in our page directory.  The flush
+   may already have been done while this CPU spun with interrupts
+   off, in which case there is nothing left to do. */
+static void
+flush_interrupt (struct intr_frame *f UNUSED)
+{
+  cpu_flush_pending ();
+}
+
+/* The local APIC raises this when an interrupt it was about to
+   deliver went away.  It needs no end-of-interrupt. */
+static void
+spurious_interrupt (struct intr_frame *f UNUSED)
+{
+}
@@ -0,0 +1,80 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <debug.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Most CPUs that we use. */
+#define CPU_MAX 8
+
+/* States of a CPU. */
+enum cpu_state
+  {
+    CPU_OFFLINE,                /* Not started. */
+    CPU_STARTING,               /* Sent startup IPIs, not yet running. */
+    CPU_RUNNING,                /* Running threads. */
+    CPU_FAILED                  /* Did not start in time, given up on. */
+  };
+
+/* A CPU. */
+struct cpu
+  {
+    /* Owned by cpu.c. */
+    unsigned id;                /* Index in cpus[]; 0 is the BSP. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    volatile enum cpu_state state; /* State. */
+
+    /* Owned by thread.c, protected by sched_lock. */
+    struct thread *current;     /* Running thread. */
+    struct thread *idle_thread; /* Runs when nothing else is ready. */
+    struct list ready_queues[PRI_MAX + 1]; /* Ready threads by priority. */
+    uint64_t ready_bitmap;      /* Bit P set if ready_queues[P] nonempty. */
+    size_t ready_cnt;           /* Threads in ready_queues. */
+    unsigned thread_ticks;      /* Ticks since the running thread began. */
+
+    /* Owned by interrupt.c, used only by this CPU. */
+    bool in_external_intr;      /* Processing an external interrupt? */
+    bool yield_on_return;       /* Yield on interrupt return? */
+    bool intr_lock_held;        /* Running thread holds the intr lock? */
+
+    /* Active page directory, set by userprog/pagedir.c, and TLB
+       flushes asked of this CPU by others and done. */
+    uint32_t *volatile pagedir; /* Active page directory. */
+    volatile unsigned flush_req; /* TLB flushes requested. */
+    volatile unsigned flush_done; /* Value of flush_req at last flush. */
+  };
+
+/* The CPUs.  Those found in the MP configuration table are
+   cpus[0] through cpus[cpu_cnt - 1], with the BSP first. */
+extern struct cpu cpus[CPU_MAX];
+extern unsigned cpu_cnt;
+
+/* True once other CPUs may be running, so that there is more to
+   mutual exclusion than turning interrupts off. */
+extern bool cpu_smp;
+
+void cpu_set_limit (unsigned);
+void cpu_init (void);
+void cpu_start_aps (void);
+struct cpu *cpu_current (void);
+void cpu_kick (struct cpu *);
+void cpu_tick_others (void);
+void cpu_flush_tlbs (uint32_t *const pds[], size_t pd_cnt);
+void cpu_flush_pending (void);
+void ap_main (void) NO_RETURN;
+
+/* Returns this CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,90 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, for the multi-level
+   feedback queue scheduler.  The kernel does not use floating
+   point, so real numbers are stored in an int scaled by 2**14,
+   which represents values up to about +/-131,071 to within
+   1/16,384.
+
+   Arguments named N are integers; arguments named X and Y are
+   fixed-point numbers. */
+
+typedef int fixed_point;
+
+/* Scale factor: 1.0 in fixed point. */
+#define FP_F (1 << 14)
+
+/* Converts integer N to fixed point. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_point x)
+{
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X + Y. */
+static inline fixed_point
+fp_add (fixed_point x, fixed_point y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_point
+fp_sub (fixed_point x, fixed_point y)
+{
+  return x - y;
+}
+
+/* Returns X + N. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * y / FP_F;
+}
+
+/* Returns X * N. */
+static inline fixed_point
+fp_mul_int (fixed_point x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return (int64_t) x * FP_F / y;
+}
+
+/* Returns X / N. */
+static inline fixed_point
+fp_div_int (fixed_point x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -15,6 +15,8 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -22,6 +24,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,6 +40,13 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/prefetch.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -54,10 +64,16 @@ static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
+#ifdef VM
+/* -ksm: Scan for identical pages to merge? */
+static bool ksm_enabled;
+#endif
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
+static bool enable_paging_feature (uint32_t cpuid_bit, uint32_t cr4_bit);
 static void paging_init (void);
 
 static char **read_command_line (void);
@@ -98,6 +114,11 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  cpu_init ();
+#ifdef VM
+  frame_init ();
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -113,12 +134,15 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+  cpu_start_aps ();
+  workqueue_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -127,6 +151,14 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize swap. */
+  swap_init ();
+  prefetch_init ();
+  if (ksm_enabled)
+    ksm_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -150,16 +182,49 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
-/* Populates the base page directory and page table with the
+/* CPUID leaf 1 feature bits, in EDX. */
+#define CPUID_PSE 0x00000008    /* Page Size Extensions supported. */
+#define CPUID_PGE 0x00002000    /* Page Global Enable supported. */
+
+/* Turns on paging feature CR4_BIT in CR4 if CPUID reports
+   CPUID_BIT, that is, if the CPU supports it.  Returns true if the
+   feature was turned on, false otherwise. */
+static bool
+enable_paging_feature (uint32_t cpuid_bit, uint32_t cr4_bit)
+{
+  uint32_t eax = 1, ebx, ecx, edx, cr4;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & cpuid_bit) == 0)
+    return false;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | cr4_bit) : "memory");
+  return true;
+}
+
+/* Populates the base page directory and page tables with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Each 4 MB of RAM that is wholly present and holds no kernel
+   text is mapped by a single 4 MB page directory entry, which
+   saves a page table and uses one TLB entry instead of 1,024.
+   The rest is mapped with 4 kB pages, so that the kernel text
+   can stay read-only.  See [IA32-v3a] 3.6.1 "Paging Options".
+
+   All of these mappings are global, so that they stay in the
+   TLB when CR3 is reloaded on a context switch.  See [IA32-v3a]
+   3.11 "Translation Lookaside Buffers (TLBs)". */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool large = enable_paging_feature (CPUID_PSE, CR4_PSE);
+  uint32_t global = enable_paging_feature (CPUID_PGE, CR4_PGE) ? PTE_G : 0;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,13 +236,22 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -251,11 +325,31 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-evict"))
+        {
+          if (!frame_set_policy (value))
+            PANIC ("unknown eviction policy `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-ksm"))
+        ksm_enabled = true;
+      else if (!strcmp (name, "-swapcache"))
+        swap_set_cache_size (atoi (value));
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_set_tickless (true);
+      else if (!strcmp (name, "-cpus"))
+        {
+          int cpu_limit = value != NULL ? atoi (value) : 0;
+          if (cpu_limit < 1)
+            PANIC ("-cpus needs a positive count (use -h for help)");
+          cpu_set_limit (cpu_limit);
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -379,8 +473,15 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Skip timer ticks when no thread needs them.\n"
+          "  -cpus=N            Use at most N CPUs.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -evict=POLICY      Evict pages by POLICY: fifo, clock, aging.\n"
+          "  -ksm               Merge identical user pages in the background.\n"
+          "  -swapcache=PAGES   Compress swapped pages in up to PAGES of RAM.\n"
 #endif
           );
   shutdown_power_off ();
@@ -3,11 +3,14 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -43,13 +46,46 @@ static unsigned int unexpected_cnt[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Whether a CPU is processing an external
+   interrupt, and whether it should yield on return, is kept in
+   its struct cpu.
+
+   Besides the devices on the PICs, the local APIC delivers
+   inter-processor interrupts (IPIs) from other CPUs, at vectors
+   LAPIC_VEC_MIN and above.  They count as external too. */
+
+/* The interrupt lock.
+
+   Much of the kernel keeps its data consistent by turning
+   interrupts off, which on a single CPU keeps out every other
+   thread as well as interrupt handlers.  With more than one CPU
+   running, that is no longer enough, so intr_disable() also
+   acquires this lock and intr_enable() releases it.  Handlers
+   for device interrupts hold it too, but not those for IPIs,
+   which touch only the scheduler and per-CPU state.  Code that
+   turns interrupts off always has interrupts off on the CPU that
+   holds the lock.
+
+   The lock belongs to the thread that acquired it: the scheduler
+   releases it while a thread is switched out and acquires it
+   again when the thread runs, on whatever CPU.  See schedule()
+   in thread.c.
+
+   The scheduler, synch.c, the timer, the PIT, and workqueues
+   protect their data with spinlocks of their own instead, which
+   may be acquired while holding this lock but not the other way
+   around.  What still relies on this lock is the serial, vga,
+   and speaker drivers, the keyboard's input buffer (input.c and
+   intq.c), the interrupt handlers that use them, the lock
+   statistics table in synch.c, and thread_foreach(), which
+   debug_backtrace_all() uses.  With one CPU the lock is never
+   touched. */
+static struct spinlock intr_lock;
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
+static void end_of_interrupt (int vec_no);
 
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
@@ -58,6 +94,8 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static bool is_external (uint8_t vec_no);
+static bool intr_lock_held (void);
 static void unexpected_interrupt (const struct intr_frame *);
 
 /* Returns the current interrupt status. */
@@ -83,25 +121,48 @@ intr_set_level (enum intr_level level)
   return level == INTR_ON ? intr_enable () : intr_disable ();
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
+/* Enables interrupts and returns the previous interrupt status.
+   Releases the interrupt lock if it is held. */
 enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  intr_lock_release ();
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
-  asm volatile ("sti");
+  asm volatile ("sti" : : : "memory");
 
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
+/* Disables interrupts and returns the previous interrupt status.
+   With more than one CPU running, also acquires the interrupt
+   lock, so that the caller excludes other CPUs' interrupts-off
+   sections as well as interrupt handlers. */
 enum intr_level
 intr_disable (void) 
+{
+  enum intr_level old_level = intr_disable_local ();
+
+  if (cpu_smp && !cpu_current ()->intr_lock_held)
+    {
+      spinlock_lock (&intr_lock);
+      cpu_current ()->intr_lock_held = true;
+    }
+
+  return old_level;
+}
+
+/* Disables interrupts on the running CPU only, without acquiring
+   the interrupt lock, and returns the previous interrupt status.
+   For code that has its own spinlocks. */
+enum intr_level
+intr_disable_local (void) 
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -112,6 +173,54 @@ intr_disable (void)
 
   return old_level;
 }
+
+/* Enables or disables interrupts on the running CPU only, as
+   specified by LEVEL, and returns the previous interrupt status.
+   Undoes intr_disable_local(); must not be used to enable
+   interrupts while the interrupt lock is held. */
+enum intr_level
+intr_set_level_local (enum intr_level level) 
+{
+  enum intr_level old_level = intr_get_level ();
+
+  if (level == INTR_ON)
+    {
+      ASSERT (!intr_lock_held ());
+      asm volatile ("sti" : : : "memory");
+    }
+  else
+    asm volatile ("cli" : : : "memory");
+
+  return old_level;
+}
+
+/* Releases the interrupt lock if the running thread holds it,
+   leaving interrupts off, and returns true if it was held. */
+bool
+intr_lock_release (void) 
+{
+  struct cpu *c;
+
+  if (!intr_lock_held ())
+    return false;
+
+  c = cpu_current ();
+  c->intr_lock_held = false;
+  spinlock_unlock (&intr_lock);
+  return true;
+}
+
+/* Returns true if the running thread holds the interrupt lock.
+   A thread that holds it has interrupts off, so with interrupts
+   on there is no need to look, and no chance of moving to
+   another CPU while looking. */
+static bool
+intr_lock_held (void) 
+{
+  return (cpu_smp
+          && intr_get_level () == INTR_OFF
+          && cpu_current ()->intr_lock_held);
+}
 
 /* Initializes the interrupt system. */
 void
@@ -157,6 +266,15 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT on an application processor.  All CPUs share
+   the IDT that intr_init() set up. */
+void
+intr_init_ap (void) 
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -181,7 +299,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,7 +320,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +329,10 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  /* External interrupts run with interrupts off, which also
+     keeps the running thread on this CPU while we look. */
+  return (intr_get_level () == INTR_OFF
+          && cpu_current ()->in_external_intr);
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +343,7 @@ void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -274,6 +395,17 @@ pic_end_of_interrupt (int irq)
     outb (0xa0, 0x20);
 }
 
+/* Acknowledges external interrupt VEC_NO to whichever interrupt
+   controller delivered it. */
+static void
+end_of_interrupt (int vec_no) 
+{
+  if (vec_no < LAPIC_VEC_MIN)
+    pic_end_of_interrupt (vec_no);
+  else if (vec_no != LAPIC_SPURIOUS)
+    lapic_eoi ();
+}
+
 /* Creates an gate that invokes FUNCTION.
 
    The gate has descriptor privilege level DPL, meaning that it
@@ -344,21 +476,31 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame) 
 {
-  bool external;
+  bool external, locked;
+  struct cpu *c;
   intr_handler_func *handler;
 
+  /* Whether the interrupted code held the interrupt lock, so that
+     we can leave it the same way. */
+  locked = intr_lock_held ();
+
   /* External interrupts are special.
-     We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
+     We only handle one at a time on a CPU (so interrupts must be
+     off), device interrupts run holding the interrupt lock, and
+     they need to be acknowledged on the PIC or local APIC (see
+     below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external (frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      if (frame->vec_no < LAPIC_VEC_MIN)
+        intr_disable ();
+      c = cpu_current ();
+      c->in_external_intr = true;
+      c->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -380,12 +522,29 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      c = cpu_current ();
+      c->in_external_intr = false;
+      end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
+      if (c->yield_on_return) 
         thread_yield (); 
     }
+
+  /* Leave the interrupt lock as the interrupted code had it.  A
+     handler for an internal interrupt may have turned interrupts
+     on and off again in between. */
+  if (locked && !intr_lock_held ())
+    intr_disable ();
+  else if (!locked)
+    intr_lock_release ();
+}
+
+/* Returns true if VEC_NO is an external interrupt, one from the
+   PICs or the local APIC. */
+static bool
+is_external (uint8_t vec_no) 
+{
+  return (vec_no >= 0x20 && vec_no < 0x30) || vec_no >= LAPIC_VEC_MIN;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -7,7 +7,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -25,20 +27,46 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
-/* A memory pool. */
+/* Number of pages that the idle thread keeps zeroed ahead of
+   time in each pool, so that PAL_ZERO requests for single pages
+   don't have to zero them while the caller waits.  These pages
+   are marked as used in the pool's used_map, but any request
+   that can't otherwise be satisfied gets them back. */
+#define ZERO_RESERVE_PAGES 32
+
+/* A memory pool.
+
+   The lock serializes searches of used_map.  Freeing pages does
+   not take it: bitmap_reset() is atomic even with more than one
+   CPU, so a thread can free pages while holding sched_lock, as
+   the scheduler does with a dead thread's page. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct lock lock;                   /* Serializes allocation. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Pre-zeroed pages, protected by a spinlock, since the idle
+       threads can't wait for a lock. */
+    struct spinlock zeroed_lock;
+    void *zeroed[ZERO_RESERVE_PAGES];
+    size_t zeroed_cnt;
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Statistics. */
+static long long prezero_cnt;   /* Pages zeroed by the idle thread. */
+static long long reserve_cnt;   /* PAL_ZERO pages taken pre-zeroed. */
+static long long demand_cnt;    /* PAL_ZERO pages zeroed on demand. */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t scan_aligned (struct pool *, size_t page_cnt);
+static void *take_zeroed (struct pool *);
+static bool release_zeroed (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,8 +105,21 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  /* Use a pre-zeroed page if we can. */
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        {
+          reserve_cnt++;
+          return pages;
+        }
+    }
+
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (page_idx == BITMAP_ERROR && release_zeroed (pool))
+    page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -89,7 +130,10 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          demand_cnt += page_cnt;
+        }
     }
   else 
     {
@@ -113,6 +157,49 @@ palloc_get_page (enum palloc_flags flags)
   return palloc_get_multiple (flags, 1);
 }
 
+/* Obtains and returns a group of PAGE_CNT contiguous free pages
+   whose physical address is a multiple of PAGE_CNT pages, as
+   needed to map them with a single large page.  PAGE_CNT must be
+   a power of 2.  FLAGS are interpreted as for
+   palloc_get_multiple().  Because aligned runs are much harder to
+   find than unaligned ones, callers should be ready to fall back
+   to smaller allocations. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  void *pages;
+  size_t page_idx;
+
+  ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+  lock_acquire (&pool->lock);
+  page_idx = scan_aligned (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && release_zeroed (pool))
+    page_idx = scan_aligned (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  lock_release (&pool->lock);
+
+  if (page_idx != BITMAP_ERROR)
+    {
+      pages = pool->base + PGSIZE * page_idx;
+      if (flags & PAL_ZERO)
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          demand_cnt += page_cnt;
+        }
+    }
+  else
+    {
+      pages = NULL;
+      if (flags & PAL_ASSERT)
+        PANIC ("palloc_get: out of aligned pages");
+    }
+
+  return pages;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
@@ -148,6 +235,128 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page ahead of time and adds it to its pool's
+   reserve of pre-zeroed pages.  Called by the idle threads, so it
+   never blocks: it gives up if a pool is busy.  Returns true if
+   it zeroed a page, false if there was nothing to do. */
+bool
+palloc_prezero (void)
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+      bool added;
+
+      if (pool->zeroed_cnt >= ZERO_RESERVE_PAGES)
+        continue;
+
+      /* An idle thread only runs when no other thread can on its
+         CPU, so it must not be preempted while it holds the lock:
+         a thread that then waited for the lock could wait forever.
+         Turning interrupts off on this CPU is enough for that. */
+      old_level = intr_disable_local ();
+      if (!lock_try_acquire (&pool->lock))
+        {
+          intr_set_level_local (old_level);
+          continue;
+        }
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+      lock_release (&pool->lock);
+      intr_set_level_local (old_level);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+
+      page = pool->base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      /* Another CPU's idle thread may have filled the reserve in
+         the meantime, in which case the page goes back. */
+      old_level = spinlock_acquire (&pool->zeroed_lock);
+      added = pool->zeroed_cnt < ZERO_RESERVE_PAGES;
+      if (added)
+        pool->zeroed[pool->zeroed_cnt++] = page;
+      spinlock_release (&pool->zeroed_lock, old_level);
+      if (!added)
+        {
+          palloc_free_page (page);
+          continue;
+        }
+
+      prezero_cnt++;
+      return true;
+    }
+  return false;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Zeroed pages: %lld by idle thread, %lld handed out pre-zeroed, "
+          "%lld zeroed on demand\n", prezero_cnt, reserve_cnt, demand_cnt);
+}
+
+/* Removes and returns a page from POOL's reserve of pre-zeroed
+   pages, or returns a null pointer if the reserve is empty. */
+static void *
+take_zeroed (struct pool *pool)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = spinlock_acquire (&pool->zeroed_lock);
+  if (pool->zeroed_cnt > 0)
+    page = pool->zeroed[--pool->zeroed_cnt];
+  spinlock_release (&pool->zeroed_lock, old_level);
+
+  return page;
+}
+
+/* Returns the index of the first page in a run of PAGE_CNT free
+   pages in POOL whose physical address is aligned to PAGE_CNT
+   pages, or BITMAP_ERROR if there is none.  POOL's lock must be
+   held. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt)
+{
+  size_t pool_pages = bitmap_size (pool->used_map);
+  uintptr_t base = vtop (pool->base);
+  size_t page_idx;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  page_idx = (ROUND_UP (base, page_cnt * PGSIZE) - base) / PGSIZE;
+  for (; page_idx + page_cnt <= pool_pages; page_idx += page_cnt)
+    if (bitmap_none (pool->used_map, page_idx, page_cnt))
+      return page_idx;
+  return BITMAP_ERROR;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its used_map, so that
+   an allocation that failed can try again.  POOL's lock must be
+   held.  Returns true if there were any such pages. */
+static bool
+release_zeroed (struct pool *pool)
+{
+  bool released = false;
+  void *page;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  while ((page = take_zeroed (pool)) != NULL)
+    {
+      bitmap_reset (pool->used_map, pg_no (page) - pg_no (pool->base));
+      released = true;
+    }
+  return released;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -164,9 +373,11 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
+  lock_init_named (&p->lock, name);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  spinlock_init (&p->zeroed_lock);
+  p->zeroed_cnt = 0;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -64,8 +64,14 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_P 0x1               /* 1=present, 0=not present. */
 #define PTE_W 0x2               /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
+#define PTE_PWT 0x8             /* 1=write-through, 0=write-back. */
+#define PTE_PCD 0x10            /* 1=cache disabled, 0=cached. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs
+                                   only, needs CR4.PSE). */
+#define PTE_G 0x100             /* 1=global, 0=flushed on CR3 load
+                                   (needs CR4.PGE). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,10 +79,43 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB page at PAGE directly,
+   without a page table.  PAGE's physical address must be 4 MB
+   aligned.  The page is readable.
+   If WRITABLE is true then it will be writable as well.
+   The page will be usable only by ring 0 code (the kernel). */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT ((vtop (page) & (PTSPAN - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a PDE that maps the 4 MB page at PAGE directly, like
+   pde_create_large(), except that the page will be usable by
+   both user and kernel code. */
+static inline uint32_t pde_create_large_user (void *page, bool writable) {
+  return pde_create_large (page, writable) | PTE_U;
+}
+
+/* Returns true if PDE, which must be "present", maps a 4 MB page
+   instead of pointing to a page table. */
+static inline bool pde_is_large (uint32_t pde) {
+  ASSERT (pde & PTE_P);
+  return (pde & PTE_PS) != 0;
+}
+
+/* Returns a pointer to the 4 MB page that PDE, which must map a
+   4 MB page, points to. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde_is_large (pde));
+  return ptov (pde & PDMASK);
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not map a 4 MB page, points
+   to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!pde_is_large (pde));
   return ptov (pde & PTE_ADDR);
 }
 
@@ -0,0 +1,84 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include "threads/cpu.h"
+
+/* Initializes spinlock L as not held. */
+void
+spinlock_init (struct spinlock *l)
+{
+  l->locked = 0;
+}
+
+/* Atomically stores VALUE in *P and returns the value that was
+   there before. */
+static inline int
+atomic_xchg (volatile int *p, int value)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (value), "+m" (*p) : : "memory");
+  return value;
+}
+
+/* Disables interrupts on this CPU, then acquires spinlock L,
+   spinning until it is free.  Returns the previous interrupt
+   level, to be passed to spinlock_release(). */
+enum intr_level
+spinlock_acquire (struct spinlock *l)
+{
+  enum intr_level old_level = intr_disable_local ();
+
+  spinlock_lock (l);
+  return old_level;
+}
+
+/* Releases spinlock L, then sets this CPU's interrupt level to
+   OLD_LEVEL, as returned by spinlock_acquire(). */
+void
+spinlock_release (struct spinlock *l, enum intr_level old_level)
+{
+  spinlock_unlock (l);
+  intr_set_level_local (old_level);
+}
+
+/* Acquires spinlock L, spinning until it is free, for a caller
+   that already has interrupts off and will leave them so. */
+void
+spinlock_lock (struct spinlock *l)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (atomic_xchg (&l->locked, 1) != 0)
+    {
+      /* Spin on a plain read, which does not take the cache line
+         away from the holder, until the lock looks free.  `pause'
+         tells the CPU that this is a spin-wait loop.  The holder
+         may be waiting for this CPU to flush its TLB, which it
+         cannot do by IPI with interrupts off. */
+      while (l->locked)
+        {
+          cpu_flush_pending ();
+          asm volatile ("pause");
+        }
+    }
+}
+
+/* Releases spinlock L, acquired by spinlock_lock(), leaving
+   interrupts off. */
+void
+spinlock_unlock (struct spinlock *l)
+{
+  ASSERT (l->locked);
+
+  /* The compiler must not move accesses to the protected data
+     past the store.  x86 does not reorder stores after earlier
+     loads or stores, so no fence is needed. */
+  asm volatile ("" : : : "memory");
+  l->locked = 0;
+}
+
+/* Returns true if spinlock L is held, by any CPU.  For use in
+   assertions. */
+bool
+spinlock_held (const struct spinlock *l)
+{
+  return l->locked != 0;
+}
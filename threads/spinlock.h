@@ -0,0 +1,39 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* A spinlock, for short critical sections that must not sleep.
+
+   Acquiring a spinlock disables interrupts on the acquiring CPU,
+   so that an interrupt handler cannot deadlock against the code
+   it interrupted.  Then it spins until no other CPU holds the
+   lock.  On a uniprocessor the lock is never contended, and a
+   spinlock costs only an atomic exchange more than disabling
+   interrupts.  Unlike disabling interrupts, though, it names the
+   data it protects and keeps protecting it with more than one
+   CPU.
+
+   A spinlock does not acquire the interrupt lock that
+   intr_disable() does (see interrupt.c).  It may be acquired
+   while holding the interrupt lock, but the interrupt lock must
+   not be acquired while holding a spinlock.
+
+   A thread must not block while holding a spinlock. */
+struct spinlock
+  {
+    volatile int locked;        /* 1 if held, 0 if free. */
+  };
+
+/* Initializer for a spinlock that is not held. */
+#define SPINLOCK_INITIALIZER { 0 }
+
+void spinlock_init (struct spinlock *);
+enum intr_level spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *, enum intr_level);
+void spinlock_lock (struct spinlock *);
+void spinlock_unlock (struct spinlock *);
+bool spinlock_held (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
@@ -28,10 +28,30 @@
 
 #include "threads/synch.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 
+/* The semaphores, locks, and reader-writer locks here keep their
+   state under the scheduler's lock, sched_lock, which also
+   protects the threads that they block and wake.  See thread.c. */
+
+/* Longest chain of lock holders that a priority donation
+   follows. */
+#define DONATION_DEPTH 8
+
+#ifdef LOCK_STAT
+static struct lock_stat *lock_stat_lookup (const char *name);
+static void lock_stat_contended (struct lock_stat *, void *site,
+                                 uint64_t wait_cycles);
+#endif
+
+static void sema_down_locked (struct semaphore *);
+static void sema_up_locked (struct semaphore *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -65,14 +85,22 @@ sema_down (struct semaphore *sema)
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&sched_lock);
+  sema_down_locked (sema);
+  spinlock_release (&sched_lock, old_level);
+}
+
+/* Does the work of sema_down().  The caller must hold
+   sched_lock. */
+static void
+sema_down_locked (struct semaphore *sema) 
+{
   while (sema->value == 0) 
     {
       list_push_back (&sema->waiters, &thread_current ()->elem);
       thread_block ();
     }
   sema->value--;
-  intr_set_level (old_level);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -88,7 +116,7 @@ sema_try_down (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&sched_lock);
   if (sema->value > 0) 
     {
       sema->value--;
@@ -96,13 +124,15 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
-  intr_set_level (old_level);
+  spinlock_release (&sched_lock, old_level);
 
   return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  Yields if that thread has a higher priority than
+   the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -112,12 +142,26 @@ sema_up (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&sched_lock);
+  sema_up_locked (sema);
+  spinlock_release (&sched_lock, old_level);
+
+  thread_preempt ();
+}
+
+/* Does the work of sema_up(), except for yielding.  The caller
+   must hold sched_lock. */
+static void
+sema_up_locked (struct semaphore *sema) 
+{
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
-  intr_set_level (old_level);
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +215,41 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   A thread waiting for a lock donates its priority to the holder,
+   and on to the thread that the holder is waiting for, and so on,
+   so that a low-priority holder cannot keep a high-priority
+   waiter waiting behind medium-priority threads.  The multi-level
+   feedback queue scheduler does not donate priority.
+
+   With LOCK_STAT defined, this function is lock_init_named(),
+   and the lock's contention statistics are kept under NAME,
+   which must remain valid. */
+#ifdef LOCK_STAT
+void
+lock_init_named (struct lock *lock, const char *name)
+#else
 void
 lock_init (struct lock *lock)
+#endif
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCK_STAT
+  lock->stat = lock_stat_lookup (name);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If LOCK is free, it is taken at once, without going through
+   the semaphore or looking for a holder to donate to.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +257,56 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCK_STAT
+  bool contended;
+  uint64_t start;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = spinlock_acquire (&sched_lock);
+#ifdef LOCK_STAT
+  contended = lock->holder != NULL;
+  start = rdtsc ();
+#endif
+  if (lock->semaphore.value > 0)
+    lock->semaphore.value--;
+  else
+    {
+      if (lock->holder != NULL && !thread_mlfqs)
+        {
+          struct lock *l = lock;
+          int depth;
+
+          /* Donate along the chain of holders.  The depth limit
+             only bounds the time spent holding sched_lock. */
+          cur->wait_lock = lock;
+          for (depth = 0; l != NULL && depth < DONATION_DEPTH; depth++)
+            {
+              struct thread *holder = l->holder;
+              if (holder == NULL || holder->priority >= cur->priority)
+                break;
+              thread_change_priority (holder, cur->priority);
+              l = holder->wait_lock;
+            }
+        }
+      sema_down_locked (&lock->semaphore);
+      cur->wait_lock = NULL;
+    }
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+#ifdef LOCK_STAT
+  lock->acquired_tsc = rdtsc ();
+  lock->stat->acquired_cnt++;
+  if (contended)
+    lock_stat_contended (lock->stat, __builtin_return_address (0),
+                         lock->acquired_tsc - start);
+#endif
+  spinlock_release (&sched_lock, old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +318,33 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  old_level = spinlock_acquire (&sched_lock);
+  success = lock->semaphore.value > 0;
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->semaphore.value--;
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+#ifdef LOCK_STAT
+      lock->acquired_tsc = rdtsc ();
+      lock->stat->acquired_cnt++;
+#endif
+    }
+  spinlock_release (&sched_lock, old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK, which may make
+   the thread yield.  If no thread is waiting for LOCK and the
+   current thread has no donations to give up, just marks LOCK
+   free.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +352,32 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = spinlock_acquire (&sched_lock);
+#ifdef LOCK_STAT
+  lock->stat->hold_cycles += rdtsc () - lock->acquired_tsc;
+#endif
+  list_remove (&lock->elem);
   lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  if (list_empty (&lock->semaphore.waiters)
+      && cur->priority == cur->base_priority)
+    {
+      /* No one to wake and no priority to lose, so no reason to
+         yield. */
+      lock->semaphore.value++;
+      spinlock_release (&sched_lock, old_level);
+      return;
+    }
+  thread_update_priority (cur);
+  sema_up_locked (&lock->semaphore);
+  spinlock_release (&sched_lock, old_level);
+
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -245,14 +390,332 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Initializes RW as an unheld reader-writer lock.  Any number
+   of readers may hold RW at once, or a single writer.
+
+   Writers are preferred: a thread that wants to read waits
+   while a writer of the same or higher priority is waiting, so
+   that a stream of readers cannot keep a writer out forever.
+   Otherwise, waiters are let in by priority.  When RW becomes
+   free, the highest-priority waiting writer gets it, unless a
+   waiting reader has a still higher priority, in which case all
+   the waiting readers of higher priority than any waiting
+   writer get it together.  Ownership passes directly to the
+   threads woken up, so none of them need to check again.
+
+   Unlike a lock, a reader-writer lock does not donate priority:
+   a writer may wait for many readers, and readers do not know
+   which of them it is waiting for. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  rw->readers = 0;
+  rw->writer = NULL;
+  list_init (&rw->read_waiters);
+  list_init (&rw->write_waiters);
+}
+
+/* Returns the highest priority among the threads in WAITERS, or
+   PRI_MIN - 1 if there are none. */
+static int
+max_waiter_priority (struct list *waiters)
+{
+  if (list_empty (waiters))
+    return PRI_MIN - 1;
+  return list_entry (list_max (waiters, thread_priority_less, NULL),
+                     struct thread, elem)->priority;
+}
+
+/* Adds the current thread to WAITERS and blocks until a thread
+   releasing the reader-writer lock hands it over.  The caller
+   must hold sched_lock. */
+static void
+rwlock_wait (struct list *waiters)
+{
+  ASSERT (spinlock_held (&sched_lock));
+
+  list_push_back (waiters, &thread_current ()->elem);
+  thread_block ();
+}
+
+/* Hands RW, which is now free, to the waiters that should have
+   it next, as described at rwlock_init().  The caller must hold
+   sched_lock. */
+static void
+rwlock_hand_over (struct rwlock *rw)
+{
+  int writer_priority = max_waiter_priority (&rw->write_waiters);
+  struct list_elem *e;
+
+  ASSERT (spinlock_held (&sched_lock));
+  ASSERT (rw->readers == 0 && rw->writer == NULL);
+
+  if (!list_empty (&rw->write_waiters)
+      && writer_priority >= max_waiter_priority (&rw->read_waiters))
+    {
+      e = list_max (&rw->write_waiters, thread_priority_less, NULL);
+      list_remove (e);
+      rw->writer = list_entry (e, struct thread, elem);
+      thread_unblock (rw->writer);
+      return;
+    }
+
+  for (e = list_begin (&rw->read_waiters); e != list_end (&rw->read_waiters); )
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (t->priority > writer_priority)
+        {
+          e = list_remove (e);
+          rw->readers++;
+          thread_unblock (t);
+        }
+      else
+        e = list_next (e);
+    }
+}
+
+/* Acquires RW for reading, sleeping until it becomes available
+   if necessary.  The current thread must not already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  old_level = spinlock_acquire (&sched_lock);
+  if (rw->writer == NULL
+      && (list_empty (&rw->write_waiters)
+          || (thread_current ()->priority
+              > max_waiter_priority (&rw->write_waiters))))
+    rw->readers++;
+  else
+    rwlock_wait (&rw->read_waiters);
+  spinlock_release (&sched_lock, old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   reading.  May make the thread yield. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->readers > 0);
+
+  old_level = spinlock_acquire (&sched_lock);
+  if (--rw->readers == 0)
+    rwlock_hand_over (rw);
+  spinlock_release (&sched_lock, old_level);
+
+  thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until it becomes available
+   if necessary.  The current thread must not already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  old_level = spinlock_acquire (&sched_lock);
+  if (rw->writer == NULL && rw->readers == 0)
+    rw->writer = cur;
+  else
+    rwlock_wait (&rw->write_waiters);
+  spinlock_release (&sched_lock, old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   writing.  May make the thread yield. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer == thread_current ());
+
+  old_level = spinlock_acquire (&sched_lock);
+  rw->writer = NULL;
+  rwlock_hand_over (rw);
+  spinlock_release (&sched_lock, old_level);
+
+  thread_preempt ();
+}
+
+#ifdef LOCK_STAT
+/* Lock contention statistics.
+
+   Locks are counted by name rather than one by one, so that
+   locks that come and go, such as those in threads and inodes,
+   add up, and so that nothing refers to a lock after it is
+   freed.  The statistics are kept in a fixed table, since many
+   locks are initialized before malloc() works; names that do not
+   fit share the last entry.  The table is protected by disabling
+   interrupts, and the counts in it by sched_lock. */
+
+/* Entries in the statistics table. */
+#define LOCK_STAT_CNT 64
+
+static struct lock_stat lock_stats[LOCK_STAT_CNT];
+static size_t lock_stat_cnt;
+
+/* Returns the statistics for locks named NAME, creating them if
+   necessary.  A leading `&', left by lock_init(), is dropped. */
+static struct lock_stat *
+lock_stat_lookup (const char *name)
+{
+  struct lock_stat *s;
+  enum intr_level old_level;
+  size_t i;
+
+  if (name[0] == '&')
+    name++;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_stat_cnt; i++)
+    if (!strcmp (lock_stats[i].name, name))
+      break;
+  if (i == lock_stat_cnt)
+    {
+      if (lock_stat_cnt < LOCK_STAT_CNT - 1)
+        lock_stats[lock_stat_cnt++].name = name;
+      else
+        {
+          i = LOCK_STAT_CNT - 1;
+          lock_stats[i].name = "(other)";
+        }
+    }
+  s = &lock_stats[i];
+  intr_set_level (old_level);
+  return s;
+}
+
+/* Records in S an acquisition from SITE that waited WAIT_CYCLES.
+   A site that is not among the LOCK_STAT_SITES recorded replaces
+   the one with the least total wait only if this one wait is
+   longer, so that an occasional waiter does not push out a
+   regular one.
+   The caller must hold sched_lock. */
+static void
+lock_stat_contended (struct lock_stat *s, void *site, uint64_t wait_cycles)
+{
+  size_t i, min;
+
+  ASSERT (spinlock_held (&sched_lock));
+
+  s->contended_cnt++;
+  s->wait_cycles += wait_cycles;
+
+  min = 0;
+  for (i = 0; i < LOCK_STAT_SITES; i++)
+    {
+      if (s->sites[i].site == site || s->sites[i].site == NULL)
+        break;
+      if (s->sites[i].wait_cycles < s->sites[min].wait_cycles)
+        min = i;
+    }
+  if (i == LOCK_STAT_SITES)
+    {
+      if (wait_cycles <= s->sites[min].wait_cycles)
+        return;
+      i = min;
+      s->sites[i].cnt = 0;
+      s->sites[i].wait_cycles = 0;
+    }
+  s->sites[i].site = site;
+  s->sites[i].cnt++;
+  s->sites[i].wait_cycles += wait_cycles;
+}
+
+/* Orders lock_stat pointers by decreasing wait time, then by
+   decreasing acquisitions. */
+static int
+lock_stat_compare (const void *a_, const void *b_)
+{
+  const struct lock_stat *a = *(struct lock_stat *const *) a_;
+  const struct lock_stat *b = *(struct lock_stat *const *) b_;
+
+  if (a->wait_cycles != b->wait_cycles)
+    return a->wait_cycles > b->wait_cycles ? -1 : 1;
+  if (a->acquired_cnt != b->acquired_cnt)
+    return a->acquired_cnt > b->acquired_cnt ? -1 : 1;
+  return 0;
+}
+
+/* Prints lock contention statistics, most waited-for locks
+   first, with the call sites that waited for each.  Call sites
+   are return addresses; the `backtrace' tool translates them
+   to source lines. */
+void
+lock_stat_print (void)
+{
+  struct lock_stat *sorted[LOCK_STAT_CNT];
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i < LOCK_STAT_CNT; i++)
+    if (lock_stats[i].acquired_cnt > 0)
+      sorted[cnt++] = &lock_stats[i];
+  qsort (sorted, cnt, sizeof *sorted, lock_stat_compare);
+
+  printf ("Locks: %-20s %10s %10s %14s %14s\n",
+          "name", "acquired", "contended", "wait cycles", "hold cycles");
+  for (i = 0; i < cnt; i++)
+    {
+      struct lock_stat *s = sorted[i];
+
+      printf ("       %-20s %10lld %10lld %14llu %14llu\n",
+              s->name, s->acquired_cnt, s->contended_cnt,
+              s->wait_cycles, s->hold_cycles);
+      for (j = 0; j < LOCK_STAT_SITES && s->sites[j].site != NULL; j++)
+        printf ("         waited at %p: %lld times, %llu cycles\n",
+                s->sites[j].site, s->sites[j].cnt,
+                s->sites[j].wait_cycles);
+    }
+}
+#endif /* LOCK_STAT */
 
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A_ has a
+   lower priority than the one waiting on B_. */
+static bool
+waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +758,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,7 +766,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +782,11 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters, waiter_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
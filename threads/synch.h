@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,19 +18,72 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+#ifdef LOCK_STAT
+/* Most call sites recorded per lock_stat. */
+#define LOCK_STAT_SITES 4
+
+/* Contention statistics, in CPU cycles, shared by all the locks
+   with the same name. */
+struct lock_stat
+  {
+    const char *name;           /* Name given to lock_init_named(). */
+    long long acquired_cnt;     /* Acquisitions. */
+    long long contended_cnt;    /* Acquisitions that had to wait. */
+    uint64_t wait_cycles;       /* Total time spent waiting. */
+    uint64_t hold_cycles;       /* Total time held. */
+    struct
+      {
+        void *site;             /* Return address into the caller. */
+        long long cnt;          /* Contended acquisitions from there. */
+        uint64_t wait_cycles;   /* Total time spent waiting there. */
+      }
+    sites[LOCK_STAT_SITES];     /* Busiest waiting call sites. */
+  };
+#endif
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+#ifdef LOCK_STAT
+    struct lock_stat *stat;     /* Contention statistics. */
+    uint64_t acquired_tsc;      /* When the holder acquired it. */
+#endif
   };
 
+/* With LOCK_STAT defined, each lock is named, by default after
+   the expression passed to lock_init(), and statistics are kept
+   for each name.  Otherwise the name is discarded. */
+#ifdef LOCK_STAT
+void lock_init_named (struct lock *, const char *name);
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+void lock_stat_print (void);
+#else
 void lock_init (struct lock *);
+#define lock_init_named(LOCK, NAME) lock_init (LOCK)
+#endif
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    unsigned readers;           /* Number of readers holding it. */
+    struct thread *writer;      /* Writer holding it, if any. */
+    struct list read_waiters;   /* Threads waiting to read. */
+    struct list write_waiters;  /* Threads waiting to write. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Condition variable. */
 struct condition 
   {
@@ -4,6 +4,9 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -20,17 +23,36 @@
 	 of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-	 that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues: processes in THREAD_READY state, that is,
+	 processes that are ready to run but not actually running.
+	 Each CPU has its own, in its struct cpu.  There is one FIFO
+	 queue per priority, and bit P of a CPU's ready_bitmap is set
+	 when its queue P is not empty, so that the highest-priority
+	 ready thread is found in constant time however many threads
+	 are ready.  A ready thread whose priority changes moves to the
+	 queue for its new priority.
+
+	 A thread that becomes ready goes back to the CPU it last ran
+	 on, unless that CPU is busy and another is idle.  A CPU whose
+	 queues are empty takes the highest-priority thread from
+	 another CPU's.
+
+	 The scheduler's lock protects every CPU's run queues and
+	 running thread, each thread's status, priority, and CPU, and
+	 the wait lists in synch.c, so that a thread can put itself on
+	 a wait list and block without another CPU waking it in
+	 between.  It is held across the switch from one thread to the
+	 next, and released by the thread switched to. */
+struct spinlock sched_lock;
 
 /* List of all processes.  Processes are added to this list
-	 when they are first scheduled and removed when they exit. */
+	 when they are first scheduled and removed when they exit.
+	 Changed only with interrupts off and sched_lock held, so that
+	 either one is enough to walk it.  thread_foreach() turns
+	 interrupts off instead of taking sched_lock, so that its
+	 function may print. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -45,25 +67,58 @@ struct kernel_thread_frame
 		void *aux;                  /* Auxiliary data for function. */
 	};
 
+/* Pages of dead threads kept for reuse by thread_create(),
+	 which saves a trip through the page allocator for each
+	 short-lived thread.  A reused page is not zeroed: init_thread()
+	 clears the struct thread, and the rest of the page is stack.
+	 Protected by sched_lock. */
+#define THREAD_CACHE_PAGES 16
+static struct thread *thread_cache[THREAD_CACHE_PAGES];
+static size_t thread_cache_cnt;
+
 /* Statistics. */
+static long long page_reuse_cnt;  /* Thread pages taken from the cache. */
+static long long page_alloc_cnt;  /* Thread pages from palloc. */
+/* Protected by sched_lock. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long steal_cnt;     /* Threads taken from another CPU. */
+
+/* Wakeup latency histogram: for each thread unblocked and then
+	 run, the time from thread_unblock() to running, counted in
+	 bucket floor(log2(cycles)).  Protected by sched_lock. */
+static long long latency_hist[LATENCY_BUCKETS];
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
 	 If true, use multi-level feedback queue scheduler.
 	 Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4  /* Ticks between priority updates. */
+static fixed_point load_avg;    /* Average number of ready threads.
+																	 Protected by sched_lock. */
+
 static void kernel_thread (thread_func *, void *aux);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static bool is_idle (const struct thread *);
+static struct cpu *choose_cpu (struct thread *);
+static void ready_push (struct cpu *, struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (const struct cpu *);
+static bool work_available (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_priority (struct thread *);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -76,7 +131,8 @@ static tid_t allocate_tid (void);
 	 general and it is possible in this case only because loader.S
 	 was careful to put the bottom of the stack at a page boundary.
 
-	 Also initializes the run queue and the tid lock.
+	 Also initializes the run queues, the scheduler's lock, and
+	 the tid lock.
 
 	 After calling this function, be sure to initialize the page
 	 allocator before trying to create any threads with
@@ -87,16 +143,24 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+	int i, p;
+
 	ASSERT (intr_get_level () == INTR_OFF);
 
+	spinlock_init (&sched_lock);
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (i = 0; i < CPU_MAX; i++)
+		for (p = 0; p <= PRI_MAX; p++)
+			list_init (&cpus[i].ready_queues[p]);
 	list_init (&all_list);
 
-	/* Set up a thread structure for the running thread. */
+	/* Set up a thread structure for the running thread, which runs
+		 on the bootstrap processor. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
+	initial_thread->cpu = &cpus[0];
+	cpus[0].current = initial_thread;
 	initial_thread->tid = allocate_tid ();
 }
 
@@ -113,19 +177,26 @@ thread_start (void)
 	/* Start preemptive thread scheduling. */
 	intr_enable ();
 
-	/* Wait for the idle thread to initialize idle_thread. */
+	/* Wait for the idle thread to initialize the BSP's
+		 idle_thread. */
 	sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
+/* Called by the timer interrupt handler at each timer tick, and
+	 on the other CPUs by the tick the BSP passes on to them.
 	 Thus, this function runs in an external interrupt context. */
 void
 thread_tick (void) 
 {
+	struct cpu *c = cpu_current ();
 	struct thread *t = thread_current ();
 
+	if (c == &cpus[0])
+		cpu_tick_others ();
+
 	/* Update statistics. */
-	if (t == idle_thread)
+	spinlock_lock (&sched_lock);
+	if (is_idle (t))
 		idle_ticks++;
 #ifdef USERPROG
 	else if (t->pagedir != NULL)
@@ -133,9 +204,13 @@ thread_tick (void)
 #endif
 	else
 		kernel_ticks++;
+	spinlock_unlock (&sched_lock);
+
+	if (thread_mlfqs)
+		mlfqs_tick (t);
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++c->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
@@ -143,8 +218,56 @@ thread_tick (void)
 void
 thread_print_stats (void) 
 {
+	long long wakeup_cnt = 0;
+	int i;
+
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 					idle_ticks, kernel_ticks, user_ticks);
+	printf ("Thread pages: %lld reused, %lld allocated\n",
+					page_reuse_cnt, page_alloc_cnt);
+	if (cpu_cnt > 1)
+		printf ("Thread: %lld taken from other CPUs\n", steal_cnt);
+
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		wakeup_cnt += latency_hist[i];
+	printf ("Wakeup latency: %lld wakeups\n", wakeup_cnt);
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		if (latency_hist[i] != 0)
+			printf ("  2**%-2d cycles: %lld\n", i, latency_hist[i]);
+}
+
+/* Returns the histogram bucket for a latency of CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+	uint32_t high = cycles >> 32;
+	uint32_t low = cycles;
+	int bit;
+
+	if (high != 0)
+		return LATENCY_BUCKETS - 1;
+	if (low == 0)
+		return 0;
+	asm ("bsrl %1, %0" : "=r" (bit) : "rm" (low));
+	return bit < LATENCY_BUCKETS ? bit : LATENCY_BUCKETS - 1;
+}
+
+/* Stores the cycles the running thread has spent ready but not
+	 running into *WAIT_CYCLES and blocked into *BLOCK_CYCLES, and
+	 copies the systemwide wakeup latency histogram into
+	 HISTOGRAM. */
+void
+thread_get_latency (uint64_t *wait_cycles, uint64_t *block_cycles,
+										long long histogram[LATENCY_BUCKETS])
+{
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	old_level = spinlock_acquire (&sched_lock);
+	*wait_cycles = cur->wait_cycles;
+	*block_cycles = cur->block_cycles;
+	memcpy (histogram, latency_hist, sizeof latency_hist);
+	spinlock_release (&sched_lock, old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +282,8 @@ thread_print_stats (void)
 	 scheduled.  Use a semaphore or some other form of
 	 synchronization if you need to ensure ordering.
 
-	 The code provided sets the new thread's `priority' member to
-	 PRIORITY, but no actual priority scheduling is implemented.
-	 Priority scheduling is the goal of Problem 1-3. */
+	 If the new thread has a higher priority than the running
+	 thread, it runs at once. */
 tid_t
 thread_create (const char *name, int priority,
 							 thread_func *function, void *aux) 
@@ -172,33 +294,28 @@ thread_create (const char *name, int priority,
 	struct switch_threads_frame *sf;
 	tid_t tid;
 	enum intr_level old_level;
-	int i;
 
 	ASSERT (function != NULL);
 
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = alloc_thread_page ();
 	if (t == NULL)
 		return TID_ERROR;
 
 	/* Initialize thread. */
 	init_thread (t, name, priority);
 	tid = t->tid = allocate_tid ();
-
-	//Point created thread to the parent
-	//Siva started driving
-	t->parent = thread_current();
-	for(i = 0; i < MAX_FILES; i++)
-		if(!thread_current()->tid_arr[i])
+	if (thread_mlfqs)
 		{
-			thread_current()->tid_arr[i] = t;
-			break;
+			/* Inherit the creator's niceness and CPU usage, which
+				 determine the priority instead of PRIORITY. */
+			t->nice = thread_current ()->nice;
+			t->recent_cpu = thread_current ()->recent_cpu;
+			old_level = spinlock_acquire (&sched_lock);
+			mlfqs_update_priority (t);
+			spinlock_release (&sched_lock, old_level);
 		}
 
-	// if(strcmp(t->name, "idle") != 0)
-	// list_push_back(&t->parent->child_list, &t->child_elem);
-	//Siva stopped driving
-
 	/* Prepare thread for first run by initializing its stack.
 		 Do this atomically so intermediate values for the 'stack' 
 		 member cannot be observed. */
@@ -222,48 +339,140 @@ thread_create (const char *name, int priority,
 	intr_set_level (old_level);
 
 	/* Add to run queue. */
+	old_level = spinlock_acquire (&sched_lock);
 	thread_unblock (t);
+	spinlock_release (&sched_lock, old_level);
+	thread_preempt ();
 
 	return tid;
 }
 
+/* Creates the idle thread for application processor C, on whose
+	 stack cpu_start_aps() starts C, and returns it, or a null
+	 pointer if memory is exhausted.  The thread counts as running
+	 on C from the start. */
+struct thread *
+thread_create_ap (struct cpu *c)
+{
+	struct thread *t;
+	char name[16];
+
+	t = alloc_thread_page ();
+	if (t == NULL)
+		return NULL;
+
+	snprintf (name, sizeof name, "idle%u", c->id);
+	init_thread (t, name, PRI_MIN);
+	t->tid = allocate_tid ();
+	t->status = THREAD_RUNNING;
+	t->cpu = c;
+	c->idle_thread = c->current = t;
+	return t;
+}
+
+/* Starts scheduling on the application processor that is
+	 running this, by running its idle thread.  Called from
+	 ap_main(), with interrupts off. */
+void
+thread_start_ap (void)
+{
+	idle_loop ();
+}
+
 /* Puts the current thread to sleep.  It will not be scheduled
 	 again until awoken by thread_unblock().
 
-	 This function must be called with interrupts turned off.  It
-	 is usually a better idea to use one of the synchronization
-	 primitives in synch.h. (For this class, you MUST use one of the
-	 synchronization primitives instead.) */
+	 This function must be called with sched_lock held, which
+	 turns interrupts off.  The thread holds it again when it
+	 returns.  It is usually a better idea to use one of the
+	 synchronization primitives in synch.h. (For this class, you
+	 MUST use one of the synchronization primitives instead.) */
 void
 thread_block (void) 
 {
 	ASSERT (!intr_context ());
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held (&sched_lock));
 
 	thread_current ()->status = THREAD_BLOCKED;
 	schedule ();
 }
 
-/* Transitions a blocked thread T to the ready-to-run state.
-	 This is an error if T is not blocked.  (Use thread_yield() to
-	 make the running thread ready.)
+/* Transitions a blocked thread T to the ready-to-run state, on
+	 the CPU chosen by choose_cpu().  This is an error if T is not
+	 blocked.  (Use thread_yield() to make the running thread
+	 ready.)
 
-	 This function does not preempt the running thread.  This can
-	 be important: if the caller had disabled interrupts itself,
-	 it may expect that it can atomically unblock a thread and
+	 The caller must hold sched_lock.  This function does not
+	 preempt the running thread.  This can be important: the
+	 caller may expect that it can atomically unblock a thread and
 	 update other data. */
 void
 thread_unblock (struct thread *t) 
 {
-	enum intr_level old_level;
+	uint64_t now;
 
 	ASSERT (is_thread (t));
-
-	old_level = intr_disable ();
+	ASSERT (spinlock_held (&sched_lock));
 	ASSERT (t->status == THREAD_BLOCKED);
-	list_push_back (&ready_list, &t->elem);
+
+	ready_push (choose_cpu (t), t);
 	t->status = THREAD_READY;
-	intr_set_level (old_level);
+	now = rdtsc ();
+	t->block_cycles += now - t->state_tsc;
+	t->state_tsc = now;
+	t->woken = true;
+
+	/* T may have to share the CPU by time slicing. */
+	timer_resume_ticks ();
+}
+
+/* Returns true if thread A, whose `elem' is A_, has a lower
+	 priority than thread B, whose `elem' is B_.  With list_max(),
+	 this finds the first of the highest-priority threads in a list
+	 of threads. */
+bool
+thread_priority_less (const struct list_elem *a_, const struct list_elem *b_,
+											void *aux UNUSED)
+{
+	const struct thread *a = list_entry (a_, struct thread, elem);
+	const struct thread *b = list_entry (b_, struct thread, elem);
+
+	return a->priority < b->priority;
+}
+
+/* Yields the CPU if a thread ready on this CPU has a higher
+	 priority than the running thread.  In an interrupt handler,
+	 the yield happens on return from the interrupt. */
+void
+thread_preempt (void)
+{
+	enum intr_level old_level = spinlock_acquire (&sched_lock);
+	struct cpu *c = cpu_current ();
+	bool yield;
+
+	yield = ready_max_priority (c) > c->current->priority;
+	spinlock_release (&sched_lock, old_level);
+
+	if (yield)
+		{
+			if (intr_context ())
+				intr_yield_on_return ();
+			else
+				thread_yield ();
+		}
+}
+
+/* Returns the number of threads ready to run on all CPUs, not
+	 counting the running threads. */
+size_t
+thread_ready_count (void)
+{
+	size_t cnt = 0;
+	unsigned i;
+
+	for (i = 0; i < cpu_cnt; i++)
+		cnt += cpus[i].ready_cnt;
+	return cnt;
 }
 
 /* Returns the name of the running thread. */
@@ -314,6 +523,7 @@ thread_exit (void)
 		 and schedule another process.  That process will destroy us
 		 when it calls thread_schedule_tail(). */
 	intr_disable ();
+	spinlock_acquire (&sched_lock);
 	list_remove (&thread_current()->allelem);
 	thread_current ()->status = THREAD_DYING;
 	schedule ();
@@ -330,12 +540,12 @@ thread_yield (void)
 	
 	ASSERT (!intr_context ());
 
-	old_level = intr_disable ();
-	if (cur != idle_thread) 
-		list_push_back (&ready_list, &cur->elem);
+	old_level = spinlock_acquire (&sched_lock);
+	if (!is_idle (cur)) 
+		ready_push (cur->cpu, cur);
 	cur->status = THREAD_READY;
 	schedule ();
-	intr_set_level (old_level);
+	spinlock_release (&sched_lock, old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
@@ -355,73 +565,241 @@ thread_foreach (thread_action_func *func, void *aux)
 		}
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  If
+	 it holds locks that higher-priority threads are waiting for, it
+	 keeps their priority until it releases them.  Yields if the
+	 thread no longer has the highest priority.  Does nothing under
+	 the multi-level feedback queue scheduler. */
 void
 thread_set_priority (int new_priority) 
 {
-	thread_current ()->priority = new_priority;
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+	/* The multi-level feedback queue scheduler sets priorities. */
+	if (thread_mlfqs)
+		return;
+
+	old_level = spinlock_acquire (&sched_lock);
+	cur->base_priority = new_priority;
+	thread_update_priority (cur);
+	spinlock_release (&sched_lock, old_level);
+
+	thread_preempt ();
+}
+
+/* Recomputes T's priority: its base priority, raised to that of
+	 the highest-priority thread waiting for any lock that T holds.
+	 The multi-level feedback queue scheduler does not donate
+	 priority, so then this does nothing.  The caller must hold
+	 sched_lock. */
+void
+thread_update_priority (struct thread *t)
+{
+	int priority = t->base_priority;
+	struct list_elem *e;
+
+	ASSERT (spinlock_held (&sched_lock));
+
+	if (thread_mlfqs)
+		return;
+
+	for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+			 e = list_next (e))
+		{
+			struct lock *lock = list_entry (e, struct lock, elem);
+			struct list *waiters = &lock->semaphore.waiters;
+
+			if (!list_empty (waiters))
+				{
+					struct thread *w = list_entry (list_max (waiters,
+																									 thread_priority_less,
+																									 NULL),
+																				 struct thread, elem);
+					if (w->priority > priority)
+						priority = w->priority;
+				}
+		}
+	thread_change_priority (t, priority);
 }
 
-/* Returns the current thread's priority. */
+/* Returns the current thread's priority, including donations. */
 int
 thread_get_priority (void) 
 {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+	 its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-	/* Not yet implemented. */
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = spinlock_acquire (&sched_lock);
+	cur->nice = nice;
+	if (thread_mlfqs)
+		mlfqs_update_priority (cur);
+	spinlock_release (&sched_lock, old_level);
+
+	thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	enum intr_level old_level = spinlock_acquire (&sched_lock);
+	int value = fp_round (fp_mul_int (load_avg, 100));
+	spinlock_release (&sched_lock, old_level);
+
+	return value;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	enum intr_level old_level = spinlock_acquire (&sched_lock);
+	int value = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+	spinlock_release (&sched_lock, old_level);
+
+	return value;
+}
+
+/* Sets T's priority from its recent_cpu and niceness:
+	 PRI_MAX - recent_cpu / 4 - nice * 2, limited to the range of
+	 valid priorities. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+	int priority = fp_trunc (fp_sub (fp_from_int (PRI_MAX - t->nice * 2),
+																	 fp_div_int (t->recent_cpu, 4)));
+
+	if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	else if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	t->base_priority = priority;
+	thread_change_priority (t, priority);
+}
+
+/* Updates the multi-level feedback queue scheduler's state for a
+	 timer tick during which T ran.  T's recent_cpu grows by one
+	 each tick.  Once a second, the load average takes in the number
+	 of threads that want to run, and every thread's recent_cpu
+	 decays by a factor that depends on the load:
+
+		 load_avg = (59/60) * load_avg + (1/60) * ready_threads
+		 recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu
+									+ nice
+
+	 Every MLFQS_PRIORITY_TICKS ticks, priorities are recomputed and
+	 the running thread is preempted if it is no longer highest.
+	 Runs in the timer interrupt handler, on every CPU, but only the
+	 BSP updates the load average and other threads' state. */
+static void
+mlfqs_tick (struct thread *t)
+{
+	int64_t ticks = timer_ticks ();
+	bool bsp = cpu_current () == &cpus[0];
+	enum intr_level old_level;
+	struct list_elem *e;
+
+	old_level = spinlock_acquire (&sched_lock);
+	if (!is_idle (t))
+		t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+	if (bsp && ticks % TIMER_FREQ == 0)
+		{
+			int ready_threads = thread_ready_count ();
+			fixed_point decay;
+			unsigned i;
+
+			for (i = 0; i < cpu_cnt; i++)
+				if (cpus[i].current != NULL && !is_idle (cpus[i].current))
+					ready_threads++;
+
+			load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+												 fp_div_int (fp_from_int (ready_threads), 60));
+			decay = fp_div (fp_mul_int (load_avg, 2),
+											fp_add_int (fp_mul_int (load_avg, 2), 1));
+			for (e = list_begin (&all_list); e != list_end (&all_list);
+					 e = list_next (e))
+				{
+					struct thread *u = list_entry (e, struct thread, allelem);
+					if (!is_idle (u))
+						u->recent_cpu = fp_add_int (fp_mul (decay, u->recent_cpu),
+																				u->nice);
+				}
+		}
+
+	if (bsp && ticks % MLFQS_PRIORITY_TICKS == 0)
+		for (e = list_begin (&all_list); e != list_end (&all_list);
+				 e = list_next (e))
+			{
+				struct thread *u = list_entry (e, struct thread, allelem);
+				if (!is_idle (u))
+					mlfqs_update_priority (u);
+			}
+	spinlock_release (&sched_lock, old_level);
+
+	if (ticks % MLFQS_PRIORITY_TICKS == 0)
+		thread_preempt ();
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-	 The idle thread is initially put on the ready list by
+	 The BSP's idle thread is initially put on the ready list by
 	 thread_start().  It will be scheduled once initially, at which
-	 point it initializes idle_thread, "up"s the semaphore passed
-	 to it to enable thread_start() to continue, and immediately
-	 blocks.  After that, the idle thread never appears in the
-	 ready list.  It is returned by next_thread_to_run() as a
-	 special case when the ready list is empty. */
+	 point it initializes the BSP's idle_thread, "up"s the semaphore
+	 passed to it to enable thread_start() to continue, and
+	 immediately blocks.  After that, the idle thread never appears
+	 in the ready list.  It is returned by next_thread_to_run() as
+	 a special case when no thread is ready.  Each AP's idle thread
+	 is made by thread_create_ap() instead. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
 	struct semaphore *idle_started = idle_started_;
-	idle_thread = thread_current ();
+	cpus[0].idle_thread = thread_current ();
 	sema_up (idle_started);
+	idle_loop ();
+}
 
+/* Body of the running CPU's idle thread. */
+static void
+idle_loop (void)
+{
 	for (;;) 
 		{
 			/* Let someone else run. */
-			intr_disable ();
+			spinlock_acquire (&sched_lock);
 			thread_block ();
 
+			/* Nothing else wants the CPU, so zero free pages ahead
+				 of time for later PAL_ZERO requests, until some thread
+				 becomes ready or there is nothing left to do. */
+			spinlock_release (&sched_lock, INTR_ON);
+			while (!work_available () && palloc_prezero ())
+				continue;
+			intr_disable_local ();
+			if (work_available ())
+				continue;
+
 			/* Re-enable interrupts and wait for the next one.
 
 				 The `sti' instruction disables interrupts until the
@@ -444,7 +822,8 @@ kernel_thread (thread_func *function, void *aux)
 {
 	ASSERT (function != NULL);
 
-	intr_enable ();       /* The scheduler runs with interrupts off. */
+	/* The scheduler runs with interrupts off, holding sched_lock. */
+	spinlock_release (&sched_lock, INTR_ON);
 	function (aux);       /* Execute the thread function. */
 	thread_exit ();       /* If function() returns, kill the thread. */
 }
@@ -475,6 +854,8 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+	enum intr_level old_level;
+
 	ASSERT (t != NULL);
 	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
 	ASSERT (name != NULL);
@@ -483,19 +864,18 @@ init_thread (struct thread *t, const char *name, int priority)
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
 	t->stack = (uint8_t *) t + PGSIZE;
-	t->priority = priority;
+	t->priority = t->base_priority = priority;
+	t->state_tsc = rdtsc ();
+	list_init (&t->held_locks);
 	t->magic = THREAD_MAGIC;
-	list_push_back (&all_list, &t->allelem);
 
-	//Initialize the variables of the created thread
-	//Siva started driving
-	list_init(&t->child_list);
-	sema_init(&t->load_sema, 0);
-	sema_init(&t->wait_sema, 0);
-	sema_init(&t->exit_sema, 0);
-	t->has_waited = false;
-	t->is_alive = true;
-	//Siva stopped driving
+	/* The timer interrupt walks all_list under the multi-level
+		 feedback queue scheduler. */
+	old_level = intr_disable ();
+	spinlock_lock (&sched_lock);
+	list_push_back (&all_list, &t->allelem);
+	spinlock_unlock (&sched_lock);
+	intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -507,33 +887,179 @@ alloc_frame (struct thread *t, size_t size)
 	ASSERT (is_thread (t));
 	ASSERT (size % sizeof (uint32_t) == 0);
 
+	/* The page may be a dead thread's, so clear the frame. */
 	t->stack -= size;
+	memset (t->stack, 0, size);
 	return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-	 return a thread from the run queue, unless the run queue is
-	 empty.  (If the running thread can continue running, then it
-	 will be in the run queue.)  If the run queue is empty, return
-	 idle_thread. */
-static struct thread *
-next_thread_to_run (void) 
+/* Returns true if T is a CPU's idle thread. */
+static bool
+is_idle (const struct thread *t)
+{
+	return t->cpu != NULL && t == t->cpu->idle_thread;
+}
+
+/* Returns true if CPU C is running its idle thread with nothing
+	 ready to run.  The caller must hold sched_lock. */
+static bool
+cpu_is_idle (const struct cpu *c)
 {
-	if (list_empty (&ready_list))
-		return idle_thread;
+	return c->current == c->idle_thread && c->ready_cnt == 0;
+}
+
+/* Returns the CPU on whose run queue to put T, which is becoming
+	 ready: the CPU that T last ran on, whose cache may still hold
+	 its data, unless that CPU is busy and another one is idle.  A
+	 new thread starts out on its creator's CPU.  The caller must
+	 hold sched_lock. */
+static struct cpu *
+choose_cpu (struct thread *t)
+{
+	struct cpu *c = t->cpu != NULL ? t->cpu : cpu_current ();
+	unsigned i;
+
+	if (cpu_is_idle (c))
+		return c;
+	for (i = 0; i < cpu_cnt; i++)
+		if (cpus[i].state == CPU_RUNNING && cpu_is_idle (&cpus[i]))
+			return &cpus[i];
+	return c;
+}
+
+/* Adds T to the back of CPU C's run queue for its priority, and
+	 has C reschedule if T should run ahead of C's running thread.
+	 The caller must hold sched_lock. */
+static void
+ready_push (struct cpu *c, struct thread *t)
+{
+	t->cpu = c;
+	list_push_back (&c->ready_queues[t->priority], &t->elem);
+	c->ready_bitmap |= (uint64_t) 1 << t->priority;
+	c->ready_cnt++;
+
+	if (c->current == c->idle_thread || t->priority > c->current->priority)
+		cpu_kick (c);
+}
+
+/* Removes T from its run queue.  The caller must hold
+	 sched_lock. */
+static void
+ready_remove (struct thread *t)
+{
+	struct cpu *c = t->cpu;
+
+	list_remove (&t->elem);
+	if (list_empty (&c->ready_queues[t->priority]))
+		c->ready_bitmap &= ~((uint64_t) 1 << t->priority);
+	c->ready_cnt--;
+}
+
+/* Returns the highest priority among threads ready on CPU C, or
+	 -1 if no thread is ready there.  The caller must hold
+	 sched_lock. */
+static int
+ready_max_priority (const struct cpu *c)
+{
+	uint32_t half;
+	int base, bit;
+
+	if (c->ready_bitmap == 0)
+		return -1;
+
+	/* `bsr' finds the most significant set bit of a 32-bit word. */
+	half = c->ready_bitmap >> 32;
+	base = 32;
+	if (half == 0)
+		{
+			half = c->ready_bitmap;
+			base = 0;
+		}
+	asm ("bsrl %1, %0" : "=r" (bit) : "rm" (half));
+	return base + bit;
+}
+
+/* Returns true if a thread is ready on any CPU.  For the idle
+	 loop, which reads the run queues without sched_lock: a thread
+	 made ready just after this looks is seen at the next
+	 interrupt. */
+static bool
+work_available (void)
+{
+	unsigned i;
+
+	for (i = 0; i < cpu_cnt; i++)
+		if (cpus[i].ready_bitmap != 0)
+			return true;
+	return false;
+}
+
+/* Sets T's priority, including donations, to PRIORITY, moving
+	 it to the matching run queue if it is ready.  The caller must
+	 hold sched_lock. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+	ASSERT (spinlock_held (&sched_lock));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	if (t->priority == priority)
+		return;
+	if (t->status == THREAD_READY && !is_idle (t))
+		{
+			ready_remove (t);
+			t->priority = priority;
+			ready_push (t->cpu, t);
+		}
 	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+		t->priority = priority;
+}
+
+/* Chooses and returns the next thread for CPU C to run: the
+	 highest-priority thread in C's run queue, or the one that has
+	 waited longest among several.  (If the running thread can
+	 continue running, then it will be in the run queue.)  If C's
+	 run queue is empty, takes the highest-priority thread from
+	 another CPU's, and if every run queue is empty, returns C's
+	 idle thread. */
+static struct thread *
+next_thread_to_run (struct cpu *c) 
+{
+	struct cpu *from = c;
+	struct thread *t;
+	int priority = ready_max_priority (c);
+	unsigned i;
+
+	if (priority < 0)
+		for (i = 0; i < cpu_cnt; i++)
+			{
+				int p = ready_max_priority (&cpus[i]);
+				if (p > priority)
+					{
+						priority = p;
+						from = &cpus[i];
+					}
+			}
+	if (priority < 0)
+		return c->idle_thread;
+
+	t = list_entry (list_front (&from->ready_queues[priority]),
+									struct thread, elem);
+	ready_remove (t);
+	if (from != c)
+		steal_cnt++;
+	return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
 	 tables, and, if the previous thread is dying, destroying it.
 
 	 At this function's invocation, we just switched from thread
-	 PREV, the new thread is already running, and interrupts are
-	 still disabled.  This function is normally invoked by
-	 thread_schedule() as its final action before returning, but
-	 the first time a thread is scheduled it is called by
-	 switch_entry() (see switch.S).
+	 PREV, the new thread is already running, interrupts are
+	 still disabled, and sched_lock is held.  This function is
+	 normally invoked by thread_schedule() as its final action
+	 before returning, but the first time a thread is scheduled it
+	 is called by switch_entry() (see switch.S).
 
 	 It's not safe to call printf() until the thread switch is
 	 complete.  In practice that means that printf()s should be
@@ -545,14 +1071,26 @@ void
 thread_schedule_tail (struct thread *prev)
 {
 	struct thread *cur = running_thread ();
+	uint64_t now = rdtsc ();
 	
 	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held (&sched_lock));
 
 	/* Mark us as running. */
 	cur->status = THREAD_RUNNING;
 
+	/* Account for the time we spent waiting for the CPU. */
+	cur->wait_cycles += now - cur->state_tsc;
+	if (cur->woken)
+		{
+			if (!is_idle (cur))
+				latency_hist[latency_bucket (now - cur->state_tsc)]++;
+			cur->woken = false;
+		}
+	cur->state_tsc = now;
+
 	/* Start new time slice. */
-	thread_ticks = 0;
+	cur->cpu->thread_ticks = 0;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -567,8 +1105,47 @@ thread_schedule_tail (struct thread *prev)
 	if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
 		{
 			ASSERT (prev != cur);
-			palloc_free_page (prev);
+			free_thread_page (prev);
+		}
+}
+
+/* Returns a page for a new thread, from the cache of dead
+	 threads' pages if possible, or a null pointer if memory is
+	 exhausted.  The page's contents are arbitrary. */
+static struct thread *
+alloc_thread_page (void)
+{
+	struct thread *t = NULL;
+	enum intr_level old_level;
+
+	old_level = spinlock_acquire (&sched_lock);
+	if (thread_cache_cnt > 0)
+		{
+			t = thread_cache[--thread_cache_cnt];
+			page_reuse_cnt++;
+		}
+	spinlock_release (&sched_lock, old_level);
+
+	if (t == NULL)
+		{
+			t = palloc_get_page (0);
+			if (t != NULL)
+				page_alloc_cnt++;
 		}
+	return t;
+}
+
+/* Frees dead thread T's page, keeping it for reuse if the cache
+	 has room.  The caller must hold sched_lock. */
+static void
+free_thread_page (struct thread *t)
+{
+	ASSERT (spinlock_held (&sched_lock));
+
+	if (thread_cache_cnt < THREAD_CACHE_PAGES)
+		thread_cache[thread_cache_cnt++] = t;
+	else
+		palloc_free_page (t);
 }
 
 /* Start of added method */
@@ -579,16 +1156,22 @@ thread_schedule_tail (struct thread *prev)
 struct thread *
 tid_to_thread(tid_t tid)
 {
-	struct thread *child = NULL;
+	struct thread *found = NULL;
+	enum intr_level old_level;
 	struct list_elem *e;
 
+	old_level = spinlock_acquire (&sched_lock);
 	for (e = list_begin (&all_list); e != list_end (&all_list);
 			 e = list_next (e))
 		{
-			child = list_entry (e, struct thread, allelem);
+			struct thread *child = list_entry (e, struct thread, allelem);
 			if(child->tid == tid)
-				break;
+				{
+					found = child;
+					break;
+				}
 		}
+	spinlock_release (&sched_lock, old_level);
 	// for (e = list_begin (&cur->child_list); e != list_end (&cur->child_list);
 	// 		 e = list_next (e))
 	// 	{
@@ -598,46 +1181,57 @@ tid_to_thread(tid_t tid)
 	// 		if(child->tid == tid)
 	// 			break;
 	// 	}
-	return child;
+	return found;
 }
 //Ruben stopped driving
-// struct thread *
-// get_a_thread (tid_t tid)
-// {
-// 	struct thread *cur = thread_current();
-// 	struct thread *child = NULL;
-// 	struct list_elem *e;
-// 	int i;
-
-// 	for(i = 0; i < MAX_FILES; i++) {
-// 		if(cur->tid_arr[i]->tid == tid)
-// 			return cur->tid_arr[i];
-// 	}
-// 	return NULL;
-// }
 /* End of added method */
 
-/* Schedules a new process.  At entry, interrupts must be off and
-	 the running process's state must have been changed from
+/* Schedules a new process.  At entry, sched_lock must be held
+	 and the running process's state must have been changed from
 	 running to some other state.  This function finds another
 	 thread to run and switches to it.
 
+	 sched_lock stays held across the switch, so that no other CPU
+	 can pick up the running thread, which may already be on a run
+	 queue, until it is off its stack.  The thread switched to
+	 releases it.
+
 	 It's not safe to call printf() until thread_schedule_tail()
 	 has completed. */
 static void
 schedule (void) 
 {
+	struct cpu *c = cpu_current ();
 	struct thread *cur = running_thread ();
-	struct thread *next = next_thread_to_run ();
+	struct thread *next = next_thread_to_run (c);
 	struct thread *prev = NULL;
+	bool intr_locked;
 
 	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held (&sched_lock));
 	ASSERT (cur->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
 
+	/* CUR is now ready, blocked, or dying. */
+	cur->state_tsc = rdtsc ();
+
+	/* CUR gives up the interrupt lock while it is switched out. */
+	intr_locked = intr_lock_release ();
+
+	next->cpu = c;
+	c->current = next;
 	if (cur != next)
 		prev = switch_threads (cur, next);
 	thread_schedule_tail (prev);
+
+	/* Take the interrupt lock back, which must be acquired before
+		 sched_lock, not after.  CUR may now be on another CPU. */
+	if (intr_locked)
+		{
+			spinlock_unlock (&sched_lock);
+			intr_disable ();
+			spinlock_lock (&sched_lock);
+		}
 }
 
 /* Returns a tid to use for a new thread. */
@@ -5,6 +5,10 @@
 #include <list.h>
 #include <stdint.h>
 #include <threads/synch.h>
+#include "threads/fixed-point.h"
+#include "threads/spinlock.h"
+
+struct cpu;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,12 +29,22 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Buckets in the wakeup latency histogram.  Bucket N counts
+	 wakeups that waited at least 2**N CPU cycles (bucket 0 also
+	 those that waited less) and, except for the last, less than
+	 2**(N+1). */
+#define LATENCY_BUCKETS 32
+
 /*Added global constants*/
 //Ruben started driving
 #define MAX_ARGS  128       /*Maximum number of cmd line args*/
 #define WORD_LENGTH 4       /*Length of a word in Pintos*/
 #define STACK_LIMIT  PHYS_BASE - PGSIZE /* How much stack can grow to */
-#define MAX_FILES 128				/* Maximum number of files a thread can have */
 //Ruben stopped driving
 
 /* A kernel thread or user process.
@@ -98,8 +112,25 @@ struct thread
 		enum thread_status status;          /* Thread state. */
 		char name[16];                      /* Name (for debugging purposes). */
 		uint8_t *stack;                     /* Saved stack pointer. */
-		int priority;                       /* Priority. */
+		int priority;                       /* Priority, including donations. */
 		struct list_elem allelem;           /* List element for all threads list. */
+		struct cpu *cpu;                    /* CPU running it, queuing it, or
+		                                       it last ran on. */
+
+		/* Scheduler latency tracing, in CPU cycles. */
+		uint64_t state_tsc;                 /* When the status last changed. */
+		uint64_t wait_cycles;               /* Total time ready but not running. */
+		uint64_t block_cycles;              /* Total time blocked. */
+		bool woken;                         /* Unblocked since it last ran? */
+
+		/* Multi-level feedback queue scheduler. */
+		int nice;                           /* Niceness. */
+		fixed_point recent_cpu;             /* Recent CPU time used. */
+
+		/* Priority donation, shared between thread.c and synch.c. */
+		int base_priority;                  /* Priority before donations. */
+		struct lock *wait_lock;             /* Lock being waited for, if any. */
+		struct list held_locks;             /* Locks held. */
 
 		/* Shared between thread.c and synch.c. */
 		struct list_elem elem;              /* List element. */
@@ -107,29 +138,11 @@ struct thread
 #ifdef USERPROG
 		/* Owned by userprog/process.c. */
 		uint32_t *pagedir;                  /* Page directory. */
+		struct process *process;            /* User process, if any. */
 #endif
 
 		/* Owned by thread.c. */
 		unsigned magic;                     /* Detects stack overflow. */
-
-		/* Added Variables */
-		//Siva and Ruben started driving
-		bool is_user_process;               /* True if a user process*/
-		bool has_loaded_process;            /* Has child loaded file */
-		bool has_waited;                    /* Has child been waited on before */
-		bool is_alive;                      /* Has the child exited or not */
-		int child_exit_status;              /* Exit status of A child */
-		struct semaphore load_sema;        /* Waits the parent for child load */
-		struct semaphore wait_sema;        /* Waits the parent for child exit */
-		struct semaphore exit_sema;			/* Child waits for parent to call wait */
-		struct thread *parent;              /* Pointer to the child's parent */
-		struct list_elem child_elem;        /**/
-		struct list child_list;             /**/
-		struct file *file_list[MAX_FILES];  /* List of files that a thread has */
-		struct thread *tid_arr[MAX_FILES];
-		int exit_arr[MAX_FILES];
-		struct file *exec_file;							/* Exec file that thread is running */
-		//Siva and Ruben stopped driving
 	};
 
 /* If false (default), use round-robin scheduler.
@@ -137,8 +150,14 @@ struct thread
 	 Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Protects the run queues and the threads' scheduling state.
+	 See thread.c. */
+extern struct spinlock sched_lock;
+
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_ap (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
@@ -148,6 +167,9 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
+size_t thread_ready_count (void);
+list_less_func thread_priority_less;
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -161,6 +183,8 @@ typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
+void thread_update_priority (struct thread *);
+void thread_change_priority (struct thread *, int priority);
 void thread_set_priority (int);
 
 int thread_get_nice (void);
@@ -168,6 +192,9 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+void thread_get_latency (uint64_t *wait_cycles, uint64_t *block_cycles,
+												 long long histogram[LATENCY_BUCKETS]);
+
 /*Added method*/
 struct thread * tid_to_thread(tid_t tid);
 struct thread * get_a_thread(tid_t tid);
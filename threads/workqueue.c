@@ -0,0 +1,345 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Workqueues.
+
+   A workqueue is a queue of work items served by a fixed pool of
+   worker threads, so that code that wants something done in the
+   background, possibly from an interrupt handler, does not need a
+   thread of its own.  A worker that wakes up takes a batch of up
+   to WORK_BATCH items at once, so a burst of work costs one
+   wakeup instead of one per item.
+
+   A work item is never queued twice: queueing a pending item does
+   nothing.  Nor does it run in two workers at once: queueing an
+   item while it runs makes the worker running it run it again
+   afterward.
+
+   The queues and items are protected by work_lock, a spinlock,
+   since interrupt handlers may queue work.  It is acquired
+   before timer_lock, because queue_delayed_work() arms a
+   timeout while holding it.  Nothing that might yield runs under
+   it, so workers are woken after it is released. */
+
+/* Most items a worker takes from the queue at a time. */
+#define WORK_BATCH 8
+
+/* Worker threads in system_wq. */
+#define SYSTEM_WORKERS 2
+
+/* A workqueue. */
+struct workqueue
+  {
+    struct list_elem elem;      /* Element in all_queues. */
+    const char *name;           /* Name, for statistics. */
+    struct list queue;          /* Pending work, oldest first. */
+    struct semaphore ready;     /* Upped once per item queued. */
+    struct list flushers;       /* Threads in flush_work(). */
+
+    /* Statistics. */
+    long long queued_cnt;       /* Items queued. */
+    long long delayed_cnt;      /* Items queued with a delay. */
+    long long run_cnt;          /* Items run. */
+    long long batch_cnt;        /* Batches taken from the queue. */
+    long long wait_ticks;       /* Total ticks items spent queued. */
+  };
+
+/* A thread waiting in flush_work(). */
+struct flusher
+  {
+    struct list_elem elem;      /* Element in workqueue's flushers. */
+    struct work *work;          /* Item being waited for. */
+    struct semaphore done;      /* Upped when it is idle. */
+  };
+
+struct workqueue *system_wq;
+
+/* All workqueues, for statistics. */
+static struct list all_queues;
+
+/* Protects all the workqueues and work items. */
+static struct spinlock work_lock;
+
+static thread_func worker_thread;
+static timeout_func delayed_work_fire;
+
+/* Initializes the workqueue subsystem and creates system_wq. */
+void
+workqueue_init (void)
+{
+  list_init (&all_queues);
+  spinlock_init (&work_lock);
+  system_wq = workqueue_create ("events", SYSTEM_WORKERS);
+  if (system_wq == NULL)
+    PANIC ("cannot create system workqueue");
+}
+
+/* Creates and returns a workqueue named NAME served by
+   WORKER_CNT worker threads, or returns a null pointer if memory
+   is exhausted.  NAME must remain valid. */
+struct workqueue *
+workqueue_create (const char *name, int worker_cnt)
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (worker_cnt > 0);
+
+  wq = calloc (1, sizeof *wq);
+  if (wq == NULL)
+    return NULL;
+  wq->name = name;
+  list_init (&wq->queue);
+  sema_init (&wq->ready, 0);
+  list_init (&wq->flushers);
+
+  old_level = spinlock_acquire (&work_lock);
+  list_push_back (&all_queues, &wq->elem);
+  spinlock_release (&work_lock, old_level);
+
+  for (i = 0; i < worker_cnt; i++)
+    {
+      char thread_name[16];
+      snprintf (thread_name, sizeof thread_name, "%s/%d", name, i);
+      thread_create (thread_name, PRI_DEFAULT, worker_thread, wq);
+    }
+  return wq;
+}
+
+/* Prints statistics for each workqueue. */
+void
+workqueue_print_stats (void)
+{
+  struct list_elem *e;
+
+  if (system_wq == NULL)
+    return;
+  for (e = list_begin (&all_queues); e != list_end (&all_queues);
+       e = list_next (e))
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+      printf ("Workqueue %s: %lld queued (%lld delayed), %lld run "
+              "in %lld batches, %lld ticks waiting\n",
+              wq->name, wq->queued_cnt, wq->delayed_cnt, wq->run_cnt,
+              wq->batch_cnt, wq->wait_ticks);
+    }
+}
+
+/* Initializes work item W to call FUNC, passing AUX. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  w->func = func;
+  w->aux = aux;
+  w->wq = NULL;
+  w->pending = false;
+  w->running = false;
+  timeout_init (&w->timeout, delayed_work_fire, w);
+}
+
+/* Adds W, which must be pending, to the back of WQ's queue,
+   unless it is running, in which case its worker runs it again
+   when it finishes.  Returns true if the caller should up WQ's
+   `ready' once it has released work_lock, which must be held. */
+static bool
+enqueue (struct workqueue *wq, struct work *w)
+{
+  ASSERT (spinlock_held (&work_lock));
+  ASSERT (w->pending);
+
+  w->queued = timer_ticks ();
+  if (w->running)
+    return false;
+  list_push_back (&wq->queue, &w->elem);
+  return true;
+}
+
+/* Queues W to run in one of WQ's workers.  Returns false if W
+   was already pending, in which case it is left alone, true
+   otherwise.  May be called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false, wake = false;
+
+  ASSERT (wq != NULL);
+
+  old_level = spinlock_acquire (&work_lock);
+  if (!w->pending)
+    {
+      ASSERT (!w->running || w->wq == wq);
+      w->wq = wq;
+      w->pending = true;
+      wq->queued_cnt++;
+      wake = enqueue (wq, w);
+      queued = true;
+    }
+  spinlock_release (&work_lock, old_level);
+
+  if (wake)
+    sema_up (&wq->ready);
+  return queued;
+}
+
+/* Queues W to run in one of WQ's workers after TICKS timer
+   ticks.  Returns false if W was already pending, in which case
+   it is left alone, true otherwise.  May be called from an
+   interrupt handler. */
+bool
+queue_delayed_work (struct workqueue *wq, struct work *w, int64_t ticks)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+
+  old_level = spinlock_acquire (&work_lock);
+  if (!w->pending)
+    {
+      ASSERT (!w->running || w->wq == wq);
+      w->wq = wq;
+      w->pending = true;
+      wq->queued_cnt++;
+      wq->delayed_cnt++;
+      timeout_add (&w->timeout, ticks);
+      queued = true;
+    }
+  spinlock_release (&work_lock, old_level);
+  return queued;
+}
+
+/* Timeout function for queue_delayed_work().  Queues the work
+   item AUX, unless it has already run. */
+static void
+delayed_work_fire (void *w_)
+{
+  struct work *w = w_;
+  struct workqueue *wq;
+  bool wake;
+
+  /* The timeout fires before work_lock is taken here, so a worker
+     that already finished W's previous run may have seen it and
+     run W again in the meantime. */
+  spinlock_lock (&work_lock);
+  wq = w->wq;
+  wake = w->pending && enqueue (wq, w);
+  spinlock_unlock (&work_lock);
+
+  if (wake)
+    sema_up (&wq->ready);
+}
+
+/* Waits until work item W is neither pending nor running.  If W
+   is queued again in the meantime, waits for that too. */
+void
+flush_work (struct work *w)
+{
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = spinlock_acquire (&work_lock);
+  if (w->pending || w->running)
+    {
+      struct flusher f;
+
+      f.work = w;
+      sema_init (&f.done, 0);
+      list_push_back (&w->wq->flushers, &f.elem);
+      spinlock_release (&work_lock, old_level);
+      sema_down (&f.done);
+    }
+  else
+    spinlock_release (&work_lock, old_level);
+}
+
+/* Runs work item W, which a worker of WQ has just taken off the
+   queue, again as long as it is queued while it runs.  (If it is
+   queued with a delay, the timeout queues it when it is due.)
+   Then, unless it is pending, wakes up the threads waiting for
+   it in flush_work(). */
+static void
+run_work (struct workqueue *wq, struct work *w)
+{
+  struct list done;
+  struct list_elem *e;
+  enum intr_level old_level;
+
+  old_level = spinlock_acquire (&work_lock);
+  do
+    {
+      w->pending = false;
+      w->running = true;
+      wq->run_cnt++;
+      wq->wait_ticks += timer_ticks () - w->queued;
+      spinlock_release (&work_lock, old_level);
+
+      w->func (w->aux);
+
+      old_level = spinlock_acquire (&work_lock);
+      w->running = false;
+    }
+  while (w->pending && !w->timeout.pending);
+  if (w->pending)
+    {
+      spinlock_release (&work_lock, old_level);
+      return;
+    }
+
+  /* Collect the flushers first: waking one may yield, and
+     another thread could change the list meanwhile. */
+  list_init (&done);
+  for (e = list_begin (&wq->flushers); e != list_end (&wq->flushers); )
+    {
+      struct flusher *f = list_entry (e, struct flusher, elem);
+      if (f->work == w)
+        {
+          e = list_remove (e);
+          list_push_back (&done, &f->elem);
+        }
+      else
+        e = list_next (e);
+    }
+  spinlock_release (&work_lock, old_level);
+
+  while (!list_empty (&done))
+    sema_up (&list_entry (list_pop_front (&done),
+                          struct flusher, elem)->done);
+}
+
+/* Worker thread for workqueue WQ_.  Takes up to WORK_BATCH items
+   from the queue at a time and runs them in order. */
+static void
+worker_thread (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  for (;;)
+    {
+      struct work *batch[WORK_BATCH];
+      enum intr_level old_level;
+      size_t n, i;
+
+      /* Another worker may already have taken the item whose
+         `ready' we consumed, so the queue may be empty. */
+      sema_down (&wq->ready);
+      old_level = spinlock_acquire (&work_lock);
+      for (n = 0; n < WORK_BATCH && !list_empty (&wq->queue); n++)
+        batch[n] = list_entry (list_pop_front (&wq->queue),
+                               struct work, elem);
+      if (n > 0)
+        wq->batch_cnt++;
+      spinlock_release (&work_lock, old_level);
+
+      for (i = 0; i < n; i++)
+        run_work (wq, batch[i]);
+    }
+}
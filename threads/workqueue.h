@@ -0,0 +1,40 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Function run by a work item. */
+typedef void work_func (void *aux);
+
+/* A work item: a function to run later in a worker thread.  The
+   owner allocates it, initializes it with work_init(), and must
+   not free it while it is pending or running; flush_work() waits
+   for both to end. */
+struct work
+  {
+    struct list_elem elem;      /* Element in workqueue's queue. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Passed to FUNC. */
+    struct workqueue *wq;       /* Queue it was last queued on. */
+    bool pending;               /* Queued or delayed, not yet started? */
+    bool running;               /* Being run by a worker? */
+    int64_t queued;             /* Tick at which it was queued. */
+    struct timeout timeout;     /* For queue_delayed_work(). */
+  };
+
+/* Shared queue for work that has no reason to have its own. */
+extern struct workqueue *system_wq;
+
+void workqueue_init (void);
+struct workqueue *workqueue_create (const char *name, int worker_cnt);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux);
+bool queue_work (struct workqueue *, struct work *);
+bool queue_delayed_work (struct workqueue *, struct work *, int64_t ticks);
+void flush_work (struct work *);
+
+#endif /* threads/workqueue.h */
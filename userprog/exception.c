@@ -2,8 +2,14 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +154,19 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Faults taken in kernel context on behalf of a system call
+     use the stack pointer saved by the system call handler. */
+  if (user)
+    thread_current ()->process->user_esp = f->esp;
+
+  /* Bring in the page, if the process is allowed to have one
+     there. */
+  if ((not_present || write) && is_user_vaddr (fault_addr)
+      && page_in (fault_addr, write))
+    return;
+#endif
+
   //Ruben started driving
   if(not_present || user)
     exit(-1);
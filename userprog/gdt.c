@@ -1,6 +1,7 @@
 #include "userprog/gdt.h"
 #include <debug.h>
 #include "userprog/tss.h"
+#include "threads/cpu.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
@@ -31,11 +32,12 @@ static uint64_t make_tss_desc (void *laddr);
 static uint64_t make_gdtr_operand (uint16_t limit, void *base);
 
 /* Sets up a proper GDT.  The bootstrap loader's GDT didn't
-   include user-mode selectors or a TSS, but we need both now. */
+   include user-mode selectors or a TSS, but we need both now.
+   Each CPU gets its own TSS. */
 void
 gdt_init (void)
 {
-  uint64_t gdtr_operand;
+  unsigned i;
 
   /* Initialize GDT. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
@@ -43,14 +45,25 @@ gdt_init (void)
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc (0);
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc (3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc (3);
-  gdt[SEL_TSS / sizeof *gdt] = make_tss_desc (tss_get ());
+  for (i = 0; i < cpu_cnt; i++)
+    gdt[SEL_TSS_CPU (i) / sizeof *gdt] = make_tss_desc (tss_get (i));
+
+  gdt_load ();
+}
+
+/* Loads the GDT that gdt_init() set up into the running CPU,
+   along with the CPU's own TSS. */
+void
+gdt_load (void)
+{
+  uint64_t gdtr_operand;
 
   /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
      Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
      6.2.4 "Task Register".  */
   gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
   asm volatile ("lgdt %0" : : "m" (gdtr_operand));
-  asm volatile ("ltr %w0" : : "q" (SEL_TSS));
+  asm volatile ("ltr %w0" : : "q" (SEL_TSS_CPU (cpu_current ()->id)));
 }
 
 /* System segment or code/data segment? */
@@ -1,16 +1,32 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
+#include "threads/flags.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* TLB statistics. */
+static long long flush_cnt;     /* Full flushes, by reloading CR3. */
+static long long invlpg_cnt;    /* Single pages flushed by INVLPG. */
+static long long large_cnt;     /* 4 MB user pages mapped. */
+static long long batch_cnt;     /* Batches flushed on other CPUs. */
+static long long batched_cnt;   /* Pages cleared in those batches. */
+
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void set_bits (uint32_t *pte, uint32_t bits);
+static void clear_bits (uint32_t *pte, uint32_t bits);
+static void invalidate_page (uint32_t *, const void *);
+static void invalidate_local (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
+   The kernel's page tables and 4 MB pages are shared with
+   init_page_dir, so only the page directory itself is copied.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t *
@@ -34,7 +50,9 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & PTE_P) && pde_is_large (*pde))
+      palloc_free_multiple (pde_get_large_page (*pde), PTSPAN / PGSIZE);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -52,7 +70,8 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  A null pointer is also returned if VADDR
+   lies in a 4 MB page of the kernel's direct map. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -80,6 +99,11 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* A 4 MB page in the kernel's direct map has no page table
+     entry to return. */
+  if (pde_is_large (*pde))
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -129,6 +153,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 
   ASSERT (is_user_vaddr (uaddr));
   
+  if (pagedir_is_large (pd, uaddr, NULL))
+    return pde_get_large_page (pd[pd_no (uaddr)]) + ((uintptr_t) uaddr
+                                                     & (PTSPAN - 1));
+
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
@@ -136,24 +164,116 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Adds a mapping in page directory PD from the 4 MB user virtual
+   region starting at UPAGE to the 4 MB run of physical pages
+   starting at kernel virtual address KPAGE, using a single large
+   page.  UPAGE must not already have a page table.  KPAGE should
+   be a run obtained from the user pool with palloc_get_aligned();
+   pagedir_destroy() frees it.
+   If WRITABLE is true, the new page is read/write;
+   otherwise it is read-only.
+   Returns true if successful, false if the CPU has large pages
+   turned off or UPAGE's region is already in use. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  uint32_t cr4;
+
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  /* Check that paging_init() turned on large pages. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if ((cr4 & CR4_PSE) == 0 || *pde != 0)
+    return false;
+
+  *pde = pde_create_large_user (kpage, writable);
+  large_cnt++;
+  return true;
+}
+
+/* Returns true if user virtual address UADDR lies in a 4 MB page
+   in PD, false otherwise.  If so, and WRITABLE is non-null, sets
+   *WRITABLE to whether the page is writable. */
+bool
+pagedir_is_large (uint32_t *pd, const void *uaddr, bool *writable)
+{
+  uint32_t pde;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pde = pd[pd_no (uaddr)];
+  if ((pde & PTE_P) == 0 || !pde_is_large (pde))
+    return false;
+  if (writable != NULL)
+    *writable = (pde & PTE_W) != 0;
+  return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
    UPAGE need not be mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
+{
+  struct tlb_batch batch;
+
+  tlb_batch_init (&batch);
+  pagedir_clear_page_batch (pd, upage, &batch);
+  tlb_batch_flush (&batch);
+}
+
+/* Marks user virtual page UPAGE "not present" in page directory
+   PD, as pagedir_clear_page() does, except that other CPUs
+   flush it from their TLBs only when BATCH is flushed.  Nothing
+   that depends on UPAGE being out of reach, such as checking its
+   dirty bit, may happen until then. */
+void
+pagedir_clear_page_batch (uint32_t *pd, void *upage,
+                          struct tlb_batch *batch) 
 {
   uint32_t *pte;
+  size_t i;
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
   pte = lookup_page (pd, upage, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    {
-      *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
-    }
+  if (pte == NULL || (*pte & PTE_P) == 0)
+    return;
+  clear_bits (pte, PTE_P);
+  invalidate_local (pd, upage);
+  batched_cnt++;
+
+  for (i = 0; i < batch->pd_cnt; i++)
+    if (batch->pds[i] == pd)
+      return;
+  if (batch->pd_cnt >= TLB_BATCH_PDS)
+    tlb_batch_flush (batch);
+  batch->pds[batch->pd_cnt++] = pd;
+}
+
+/* Initializes BATCH as empty. */
+void
+tlb_batch_init (struct tlb_batch *batch)
+{
+  batch->pd_cnt = 0;
+}
+
+/* Makes the other CPUs flush the pages cleared in BATCH from
+   their TLBs, waits until they have, and empties BATCH. */
+void
+tlb_batch_flush (struct tlb_batch *batch)
+{
+  if (batch->pd_cnt == 0)
+    return;
+  cpu_flush_tlbs (batch->pds, batch->pd_cnt);
+  batch->pd_cnt = 0;
+  batch_cnt++;
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -167,6 +287,15 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PD is
+   present and writable, false otherwise. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
    in PD. */
 void
@@ -176,11 +305,11 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
   if (pte != NULL) 
     {
       if (dirty)
-        *pte |= PTE_D;
+        set_bits (pte, PTE_D);
       else 
         {
-          *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          clear_bits (pte, PTE_D);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -205,29 +334,57 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
   if (pte != NULL) 
     {
       if (accessed)
-        *pte |= PTE_A;
+        set_bits (pte, PTE_A);
       else 
         {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          /* Other CPUs are not made to flush.  One that has the
+             page in its TLB does not set the accessed bit again
+             until the entry leaves its TLB, which only makes the
+             page look idle for longer.  That is not worth an IPI
+             round trip per page in the eviction scans. */
+          clear_bits (pte, PTE_A);
+          invalidate_local (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already loaded.  Either way, the kernel's
+   global mappings stay in the TLB. */
 void
 pagedir_activate (uint32_t *pd) 
 {
+  enum intr_level old_level;
+
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  /* Record PD as this CPU's before loading it, so that a CPU
+     that changes PD from now on asks this one to flush.  A change
+     made earlier is flushed by loading CR3. */
+  old_level = intr_disable_local ();
+  cpu_current ()->pagedir = pd;
+  if (active_pd () != pd)
+    {
+      /* Store the physical address of the page directory into CR3
+         aka PDBR (page directory base register).  This activates
+         our new page tables immediately.  See [IA32-v2a]
+         "MOV--Move to/from Control Registers" and [IA32-v3a] 3.7.5
+         "Base Address of the Page Directory". */
+      asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+      flush_cnt++;
+    }
+  intr_set_level_local (old_level);
+}
+
+/* Prints TLB statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("TLB: %lld flushes, %lld single-page invalidations, "
+          "%lld 4 MB user pages\n", flush_cnt, invlpg_cnt, large_cnt);
+  printf ("TLB shootdowns: %lld pages unmapped in %lld batches\n",
+          batched_cnt, batch_cnt);
 }
 
 /* Returns the currently active page directory. */
@@ -243,21 +400,52 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Sets BITS in *PTE.  The update is atomic, because the CPU sets
+   the accessed and dirty bits of a PTE in use by another CPU at
+   any time. */
+static void
+set_bits (uint32_t *pte, uint32_t bits)
+{
+  asm volatile ("lock orl %1, %0" : "+m" (*pte) : "r" (bits) : "memory");
+}
+
+/* Clears BITS in *PTE, atomically, as set_bits() does. */
+static void
+clear_bits (uint32_t *pte, uint32_t bits)
+{
+  asm volatile ("lock andl %1, %0" : "+m" (*pte) : "r" (~bits)
+                : "memory");
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   TLB entry.
+
+   This function invalidates the TLB entry for VADDR if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Only the one page is flushed, with INVLPG, so the
+   rest of the TLB survives.  See [IA32-v3a] 3.12 "Translation
+   Lookaside Buffers (TLBs)".  Other CPUs on which PD is active
+   flush their whole TLBs, by cpu_flush_tlbs(). */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr) 
+{
+  invalidate_local (pd, vaddr);
+  cpu_flush_tlbs (&pd, 1);
+}
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+/* Invalidates the TLB entry for VADDR on this CPU only, if PD is
+   active here. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_local (uint32_t *pd, const void *vaddr) 
 {
+  enum intr_level old_level = intr_disable_local ();
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      invlpg_cnt++;
     } 
+  intr_set_level_local (old_level);
 }
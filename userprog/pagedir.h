@@ -2,17 +2,42 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* A batch of TLB flushes for other CPUs.  A page cleared with
+   pagedir_clear_page_batch() leaves this CPU's TLB at once, but
+   other CPUs on which its page directory is active flush only at
+   tlb_batch_flush(), so that clearing many pages costs one round
+   of IPIs instead of one per page.  Until then, those CPUs may
+   still reach the cleared pages. */
+#define TLB_BATCH_PDS 8
+
+struct tlb_batch
+  {
+    uint32_t *pds[TLB_BATCH_PDS];       /* Page directories changed. */
+    size_t pd_cnt;                      /* Number of PDS in use. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                             bool rw);
+bool pagedir_is_large (uint32_t *pd, const void *upage, bool *writable);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_clear_page_batch (uint32_t *pd, void *upage,
+                               struct tlb_batch *);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_print_stats (void);
+
+void tlb_batch_init (struct tlb_batch *);
+void tlb_batch_flush (struct tlb_batch *);
 
 #endif /* userprog/pagedir.h */
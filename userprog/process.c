@@ -15,10 +15,23 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
+
+/* Passed from process_execute() to start_process(). */
+struct exec_info
+	{
+		char *cmd_line;             /* Page holding the command line. */
+		struct process *process;    /* The new process's state. */
+	};
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
@@ -27,6 +40,18 @@ static bool load (const char *cmdline, void (**eip) (void), void **esp);
 char *argv[MAX_ARGS];				/*Stores the command line args*/
 int argc;										/*Count of how many cmd lne args*/
 
+/* Serializes process_execute(), which passes the command line to
+	 the new process in argv and argc, until the new process has
+	 finished loading. */
+static struct lock exec_lock;
+
+/* Initializes the process loader. */
+void
+process_init (void)
+{
+	lock_init (&exec_lock);
+}
+
 /* Starts a new thread running a user program loaded from
 	 FILENAME.  The new thread may be scheduled (and may even exit)
 	 before process_execute() returns.  Returns the new process's
@@ -44,8 +69,8 @@ process_execute (const char *file_name)
 	//Added local variables
 	char *token, *save_ptr;
 	int index = 0; 
-	argc = 0;
-	struct thread *cur;
+	struct exec_info info;
+	struct process *p;
 
 	/* Make a copy of FILE_NAME.
 		 Otherwise there's a race between the caller and load(). */
@@ -54,6 +79,27 @@ process_execute (const char *file_name)
 		return TID_ERROR;
 	strlcpy (fn_copy, file_name, PGSIZE);
 
+	/* The new process's state, zeroed so that it has no open
+		 files. */
+	p = calloc (1, sizeof *p);
+	if (p == NULL)
+		{
+			palloc_free_page (fn_copy);
+			return TID_ERROR;
+		}
+	p->parent = thread_current ();
+	sema_init (&p->load_sema, 0);
+	sema_init (&p->exit_sema, 0);
+	sema_init (&p->wait_sema, 0);
+	p->is_alive = true;
+#ifdef VM
+	lock_init (&p->page_in_lock);
+	list_init (&p->mappings);
+#endif
+
+	lock_acquire (&exec_lock);
+	argc = 0;
+
 	//Ruben started driving
 	for (token = strtok_r (fn_copy, " ", &save_ptr); token != NULL;
 				token = strtok_r (NULL, " ", &save_ptr))
@@ -64,18 +110,25 @@ process_execute (const char *file_name)
 	//Ruben stopped driving
 
 	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create (argv[0], PRI_DEFAULT, start_process, fn_copy);
+	info.cmd_line = fn_copy;
+	info.process = p;
+	tid = thread_create (argv[0], PRI_DEFAULT, start_process, &info);
 
 	if (tid == TID_ERROR)
-		palloc_free_page (fn_copy);
-
-	cur = tid_to_thread(tid);
-	if(!cur)
-		return -1;
-	sema_down(&cur->load_sema);
+		{
+			palloc_free_page (fn_copy);
+			free (p);
+			lock_release (&exec_lock);
+			return -1;
+		}
+	sema_down(&p->load_sema);
+	lock_release (&exec_lock);
 
-	if(!thread_current()->has_loaded_process)
-		tid = -1;
+	if(!p->loaded)
+		{
+			free (p);
+			tid = -1;
+		}
 	// printf("PPID: %d\n", tid);
 	return tid;
 }
@@ -84,14 +137,20 @@ process_execute (const char *file_name)
 	 running. */
 /* Added code comments: */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-	char *file_name = file_name_;
+	struct exec_info *info = info_;
+	char *file_name = info->cmd_line;
+	struct process *p = info->process;
 	struct intr_frame if_;
 	bool success;
 	//Added vars
 	struct thread *child = thread_current();
 
+	/* INFO is on the parent's stack, which it leaves once we up
+		 load_sema. */
+	child->process = p;
+
 	/* Initialize interrupt frame and load executable. */
 	memset (&if_, 0, sizeof if_);
 	if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -101,9 +160,22 @@ start_process (void *file_name_)
 	success = load (file_name, &if_.eip, &if_.esp);
 	// printf("%d\n", success);
 	//ADDED Code
-	child->is_user_process = true;
-	child->parent->has_loaded_process = success;
-	sema_up(&child->load_sema);
+	if (!success)
+		{
+			/* The parent frees P when it sees the failure. */
+			if (p->exec_file != NULL)
+				{
+					lock_acquire (&file_lock);
+					file_close (p->exec_file);
+					lock_release (&file_lock);
+				}
+#ifdef VM
+			page_exit ();
+#endif
+			child->process = NULL;
+		}
+	p->loaded = success;
+	sema_up(&p->load_sema);
 
 	/* If load failed, quit. */
 	palloc_free_page (file_name);
@@ -138,34 +210,40 @@ start_process (void *file_name_)
 	been waited on before. If no errors are to be returned, then the
 	parent waits on the child by calling sema_down and retrieves the
 	status that is returned by the child.
-	sema_up(exit_sema) is called to ensure that the parent keeps track
-	of the appropriate child_exit_status in the correct order.*/
+	sema_up(exit_sema) lets the child finish exiting, and is called
+	only by the parent that actually waits, so that a bad call cannot
+	let some other process's child go before its parent waits.*/
 	
 //Ruben and Siva started driving
 int
 process_wait (tid_t child_tid) 
 {
 	struct thread *child, *cur;
+	struct process *p;
+	int status;
 
 	cur = thread_current();
 	child = tid_to_thread(child_tid);
 
-	sema_up(&child->exit_sema);
-	
-	if(child == NULL)
+	if(child == NULL || child->process == NULL)
 		return -1;
+	p = child->process;
 
-	if(strcmp(child->parent->name, cur->name) != 0)
+	if(p->parent != cur)
 		return -1;
 
-	if(child->has_waited)
+	if(p->has_waited)
 		return -1;
 
-	child->has_waited = true;
-	if(child->is_alive)
+	p->has_waited = true;
+	if(p->is_alive)
 		{
-			sema_down(&cur->wait_sema);
-			return cur->child_exit_status;
+			/* The child is done with P once it ups wait_sema. */
+			sema_up(&p->exit_sema);
+			sema_down(&p->wait_sema);
+			status = p->exit_status;
+			free (p);
+			return status;
 		}
 	else
 		return -1;
@@ -179,6 +257,18 @@ process_exit (void)
 	struct thread *cur = thread_current ();
 	uint32_t *pd;
 
+#ifdef VM
+	/* Write back and close memory-mapped files, then release the
+		 process's pages, frames, and swap slots while its page
+		 directory is still around to unmap them from.  exit() has
+		 usually done both already, and let go of the process. */
+	if (cur->process != NULL)
+		{
+			syscall_exit ();
+			page_exit ();
+		}
+#endif
+
 	/* Destroy the current process's page directory and switch back
 		 to the kernel-only page directory. */
 	pd = cur->pagedir;
@@ -280,7 +370,10 @@ static bool setup_stack (void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 													uint32_t read_bytes, uint32_t zero_bytes,
-													bool writable);
+													bool writable, bool large);
+static bool load_large_page (struct file *file, off_t *ofs, uint8_t **upage,
+														 uint32_t *read_bytes, uint32_t *zero_bytes,
+														 bool writable);
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
 	 Stores the executable's entry point into *EIP
@@ -302,7 +395,16 @@ load (const char *file_name, void (**eip) (void), void **esp)
 		goto done;
 	process_activate ();
 
+#ifdef VM
+	/* Create supplemental page table. */
+	t->process->pages = malloc (sizeof *t->process->pages);
+	if (t->process->pages == NULL)
+		goto done;
+	hash_init (t->process->pages, page_hash, page_less, NULL);
+#endif
+
 	/* Open executable file. */
+	lock_acquire (&file_lock);
 	file = filesys_open (file_name);
 	if (file == NULL) 
 		{
@@ -313,7 +415,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	//the current thread remember this file
 	//Siva started driving
 	file_deny_write(file);
-	t->exec_file = file;
+	t->process->exec_file = file;
 	//Siva stopped driving
 
 	/* Read and verify executable header. */
@@ -378,8 +480,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
 									read_bytes = 0;
 									zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
 								}
+							/* A segment aligned to 4 MB or more asks for 4 MB
+								 pages. */
+							bool large = phdr.p_align >= PTSPAN;
 							if (!load_segment (file, file_page, (void *) mem_page,
-																 read_bytes, zero_bytes, writable))
+																 read_bytes, zero_bytes, writable, large))
 								goto done;
 						}
 					else
@@ -388,6 +493,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
 				}
 		}
 
+	lock_release (&file_lock);
+
 	/* Set up stack. */
 	if (!setup_stack (esp))
 		goto done;
@@ -399,6 +506,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
 	/* We arrive here whether the load is successful or not. */
+	if (lock_held_by_current_thread (&file_lock))
+		lock_release (&file_lock);
 	return success;
 }
 
@@ -463,16 +572,51 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
 	 The pages initialized by this function must be writable by the
 	 user process if WRITABLE is true, read-only otherwise.
 
+	 If LARGE is true, each 4 MB-aligned 4 MB of the segment is
+	 loaded into a single 4 MB page if possible.
+
 	 Return true if successful, false if a memory allocation error
 	 or disk read error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
-							uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
+							uint32_t read_bytes, uint32_t zero_bytes, bool writable,
+							bool large) 
 {
 	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+	/* Just record where each page comes from.  The page is read
+		 in from FILE on its first fault. */
+	while (read_bytes > 0 || zero_bytes > 0)
+		{
+			size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+			size_t page_zero_bytes = PGSIZE - page_read_bytes;
+			struct page *p;
+
+			if (large && load_large_page (file, &ofs, &upage, &read_bytes,
+																		&zero_bytes, writable))
+				continue;
+
+			p = page_allocate (upage, !writable);
+			if (p == NULL)
+				return false;
+			if (page_read_bytes > 0)
+				{
+					p->file = file;
+					p->file_offset = ofs;
+					p->file_bytes = page_read_bytes;
+				}
+
+			/* Advance. */
+			read_bytes -= page_read_bytes;
+			zero_bytes -= page_zero_bytes;
+			ofs += page_read_bytes;
+			upage += PGSIZE;
+		}
+	return true;
+#else
 	file_seek (file, ofs);
 	while (read_bytes > 0 || zero_bytes > 0) 
 		{
@@ -481,9 +625,17 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 				 and zero the final PAGE_ZERO_BYTES bytes. */
 			size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 			size_t page_zero_bytes = PGSIZE - page_read_bytes;
+			uint8_t *kpage;
+
+			if (large && load_large_page (file, &ofs, &upage, &read_bytes,
+																		&zero_bytes, writable))
+				{
+					file_seek (file, ofs);
+					continue;
+				}
 
 			/* Get a page of memory. */
-			uint8_t *kpage = palloc_get_page (PAL_USER);
+			kpage = palloc_get_page (PAL_USER);
 			if (kpage == NULL)
 				return false;
 
@@ -505,9 +657,58 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 			/* Advance. */
 			read_bytes -= page_read_bytes;
 			zero_bytes -= page_zero_bytes;
+			ofs += page_read_bytes;
 			upage += PGSIZE;
 		}
 	return true;
+#endif
+}
+
+/* Tries to load the next 4 MB of a segment being loaded by
+	 load_segment(), which is described by *OFS, *UPAGE,
+	 *READ_BYTES, and *ZERO_BYTES, into a single 4 MB page.  This
+	 works only if *UPAGE is 4 MB aligned, at least 4 MB of the
+	 segment remain, and the user pool has a free 4 MB-aligned run
+	 of pages.
+	 Returns true and advances *OFS, *UPAGE, *READ_BYTES, and
+	 *ZERO_BYTES past the 4 MB if successful.  Returns false and
+	 leaves them unchanged otherwise, so that the caller can fall
+	 back to 4 kB pages. */
+static bool
+load_large_page (struct file *file, off_t *ofs, uint8_t **upage,
+								 uint32_t *read_bytes, uint32_t *zero_bytes, bool writable)
+{
+	uint32_t large_read_bytes = *read_bytes < PTSPAN ? *read_bytes : PTSPAN;
+	uint8_t *kpage;
+
+	if (((uintptr_t) *upage & (PTSPAN - 1)) != 0
+			|| *read_bytes + *zero_bytes < PTSPAN)
+		return false;
+
+	kpage = palloc_get_aligned (PAL_USER, PTSPAN / PGSIZE);
+	if (kpage == NULL)
+		return false;
+
+	if (file_read_at (file, kpage, large_read_bytes, *ofs)
+			!= (int) large_read_bytes)
+		{
+			palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+			return false;
+		}
+	memset (kpage + large_read_bytes, 0, PTSPAN - large_read_bytes);
+
+	if (!pagedir_set_large_page (thread_current ()->pagedir, *upage, kpage,
+															 writable))
+		{
+			palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+			return false;
+		}
+
+	*read_bytes -= large_read_bytes;
+	*zero_bytes -= PTSPAN - large_read_bytes;
+	*ofs += large_read_bytes;
+	*upage += PTSPAN;
+	return true;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -521,13 +722,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
-	uint8_t *kpage;
 	bool success = false;
 	//Added local variables
 	char *curr_str;
 	uint8_t word_align = 0;
 	int i, temp_ptr;
-	
+#ifdef VM
+	struct page *p;
+	struct frame *frame = NULL;
+
+	/* The stack page is an ordinary anonymous page, but it stays
+		 locked in its frame until the arguments have been pushed. */
+	p = page_allocate (((uint8_t *) PHYS_BASE) - PGSIZE, false);
+	if (p != NULL)
+		{
+			frame = p->frame = frame_alloc_and_lock (p, true);
+			if (frame != NULL)
+				success = install_page (p->addr, frame->base, true);
+		}
+#else
+	uint8_t *kpage;
+
 	kpage = palloc_get_page (PAL_USER | PAL_ZERO);
 	if (kpage != NULL) 
 		{
@@ -537,7 +752,9 @@ setup_stack (void **esp)
 			else
 				palloc_free_page (kpage);
 		}
-		// printf("Here\n");
+#endif
+	if (!success)
+		goto done;
 	*esp = PHYS_BASE;
 
 	//Push the cmd line strings onto the stack
@@ -547,15 +764,15 @@ setup_stack (void **esp)
 			*esp -= strlen(curr_str) + 1;
 			
 			if((*esp) < STACK_LIMIT)
-				{	
-					palloc_free_page (kpage);
-					return false;
+				{
+					success = false;
+					goto done;
 				}
 			
 			if(((*esp) - (strlen(curr_str) + 1)) < STACK_LIMIT)
 			{
-				palloc_free_page (kpage);
-				return false;
+				success = false;
+				goto done;
 			}
 			strlcpy((char *) (*esp), curr_str, strlen(curr_str) + 1);
 		}
@@ -567,8 +784,8 @@ setup_stack (void **esp)
 
 	if(*esp < STACK_LIMIT) 
 		{
-			palloc_free_page (kpage);
-			return false;
+			success = false;
+			goto done;
 		}
 
 	//Push the null sentinel
@@ -577,8 +794,8 @@ setup_stack (void **esp)
 
 	if(*esp < STACK_LIMIT) 
 		{
-			palloc_free_page (kpage);
-			return false;
+			success = false;
+			goto done;
 		}
 
 	//Siva stopped driving
@@ -593,8 +810,8 @@ setup_stack (void **esp)
 			*esp -= WORD_LENGTH;
 			if(*esp < STACK_LIMIT) 
 				{
-					palloc_free_page (kpage);
-					return false;
+					success = false;
+					goto done;
 				}
 			memcpy(*esp, &temp_ptr, WORD_LENGTH);
 		}
@@ -606,8 +823,8 @@ setup_stack (void **esp)
 
 	if(*esp < STACK_LIMIT) 
 		{
-			palloc_free_page (kpage);
-			return false;
+			success = false;
+			goto done;
 		}
 
 	//Push argc
@@ -616,8 +833,8 @@ setup_stack (void **esp)
 
 	if(*esp < STACK_LIMIT) 
 		{
-			palloc_free_page (kpage);
-			return false;
+			success = false;
+			goto done;
 		}
 
 	//Push "return address"
@@ -626,11 +843,16 @@ setup_stack (void **esp)
 
 	if(*esp < STACK_LIMIT)
 		{
-			palloc_free_page (kpage);
-			return false;
+			success = false;
+			goto done;
 		}
 
 	//Ruben stopped driving
+ done:
+#ifdef VM
+	if (frame != NULL)
+		frame_unlock (frame);
+#endif
 	return success;
 }
 
@@ -1,8 +1,47 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <list.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
 
+#define MAX_FILES 128				/* Maximum number of files a process can have */
+
+/* Per-process state of a user process, kept apart from its
+	 struct thread so that kernel threads do not carry it and the
+	 kernel stack keeps its room.  The parent allocates it in
+	 process_execute() and frees it once it has waited for the
+	 process, or once the process has failed to load.  The process
+	 stops using it before it signals wait_sema. */
+struct process
+	{
+		struct thread *parent;              /* Thread that started this one. */
+		struct semaphore load_sema;         /* Upped when loading finishes. */
+		bool loaded;                        /* Did loading succeed? */
+		struct semaphore exit_sema;         /* Exit waits for the parent to wait. */
+		struct semaphore wait_sema;         /* Upped when exit_status is set. */
+		bool has_waited;                    /* Has it been waited on before? */
+		bool is_alive;                      /* Has it not yet exited? */
+		int exit_status;                    /* Exit status. */
+		struct file *exec_file;             /* Executable, denied writes. */
+		struct file *file_list[MAX_FILES];  /* Open files, indexed by fd. */
+
+#ifdef VM
+		/* Owned by vm/page.c. */
+		struct hash *pages;                 /* Supplemental page table. */
+		void *user_esp;                     /* User's stack pointer. */
+		void *ra_next;                      /* Next page if reading ahead. */
+		size_t ra_window;                   /* Read-ahead window, in pages. */
+		struct lock page_in_lock;           /* Serializes paging in with
+		                                       vm/prefetch.c. */
+
+		/* Owned by userprog/syscall.c. */
+		struct list mappings;               /* Memory-mapped files. */
+		int next_mapid;                     /* Next mapping id. */
+#endif
+	};
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
@@ -2,6 +2,7 @@
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -12,6 +13,13 @@
 #include "lib/user/syscall.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#ifdef VM
+#include <list.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
@@ -19,6 +27,23 @@ static void syscall_handler (struct intr_frame *);
 bool pointer_valid (void * given_addr);
 bool fd_valid (int fd);
 struct file * fd_to_file (int fd);
+#ifdef VM
+/* A memory-mapped file. */
+struct mapping
+	{
+		struct list_elem elem;      /* List element in thread's mappings. */
+		int handle;                 /* Mapping id. */
+		struct file *file;          /* File. */
+		uint8_t *base;              /* Start of memory mapping. */
+		size_t page_cnt;            /* Number of pages mapped. */
+	};
+
+static struct mapping *lookup_mapping (int handle);
+static void unmap (struct mapping *m);
+static void pin_buffer (const void *buffer, unsigned size, bool will_write);
+static void unpin_buffer (const void *buffer, unsigned size);
+static unsigned pin_string (const char *str);
+#endif
 
 /* Added global variables */
 struct lock file_lock;
@@ -44,6 +69,12 @@ syscall_handler (struct intr_frame *f UNUSED)
 
 	// printf("herer\n");
 
+#ifdef VM
+	/* A page fault taken while the kernel touches user memory
+		 needs the user stack pointer to decide on stack growth. */
+	thread_current ()->process->user_esp = f->esp;
+#endif
+
 	//Checks the validity of the esp location
 	if(!pointer_valid(f->esp))
 		exit(-1);
@@ -93,6 +124,16 @@ syscall_handler (struct intr_frame *f UNUSED)
 		{
 			close(first_arg);
 		}
+	else if (call_num == SYS_SCHEDSTAT)
+		{
+			f->eax = schedstat((struct schedstat *) first_arg);
+		}
+#ifdef VM
+	else if (call_num == SYS_MUNMAP)
+		{
+			munmap((mapid_t) first_arg);
+		}
+#endif
 
 	//Ruben stopped driving
 	//Siva started driving
@@ -111,6 +152,12 @@ syscall_handler (struct intr_frame *f UNUSED)
 		{
 			seek(first_arg, (unsigned) second_arg);
 		}
+#ifdef VM
+	else if (call_num == SYS_MMAP)
+		{
+			f->eax = mmap(first_arg, (void *) second_arg);
+		}
+#endif
 
 	//Get 3rd argument and check it's validity
 	third_arg = * (int *) (f->esp + (3 * WORD_LENGTH));
@@ -126,6 +173,12 @@ syscall_handler (struct intr_frame *f UNUSED)
 		{ 
 			f->eax = write(first_arg, (const void *) second_arg, (unsigned) third_arg);
 		}
+#ifdef VM
+	else if (call_num == SYS_MADVISE)
+		{
+			f->eax = madvise((void *) first_arg, (unsigned) second_arg, third_arg);
+		}
+#endif
 }
 //Siva stopped driving
 
@@ -140,29 +193,42 @@ halt (void)
 
 /*Exit system call - Closes the thread's exec file to reenable
   writing to it and saves the status directly to the child's 
-  parent. Wakes up the waiting parent and prints the proper 
-  exit message, if it's a user process.*/
+  parent. Tears down the process's files and memory, prints the
+  proper exit message, and only then wakes up the waiting parent,
+  so that the parent sees everything the child wrote.*/
 
 //Siva started driving
 void
 exit (int status)
 {
 	struct thread *cur = thread_current();
+	struct process *p = cur->process;
+	int fd;
 
 	lock_acquire(&file_lock);
-	file_close(cur->exec_file);
+	file_close(p->exec_file);
+	for(fd = 2; fd < MAX_FILES; fd++)
+		file_close(p->file_list[fd]);
 	lock_release(&file_lock);	
+
+#ifdef VM
+	/* Write back memory-mapped files before the parent can wake
+		 up and read them, and give back our frames and swap slots
+		 while we are at it. */
+	syscall_exit();
+	page_exit();
+#endif
 	
-	sema_down(&cur->exit_sema);
-	
-	cur->parent->child_exit_status = status;
-	cur->is_alive = false;
-	// printf("status %d\n", status);
-	sema_up(&cur->parent->wait_sema);
-	if(cur->is_user_process)
-		printf("%s: exit(%d)\n", cur->name, status);
+	sema_down(&p->exit_sema);
 	
+	p->exit_status = status;
+	p->is_alive = false;
+	printf("%s: exit(%d)\n", cur->name, status);
 
+	/* Nothing may touch P after this: the parent frees it once it
+		 wakes up. */
+	cur->process = NULL;
+	sema_up(&p->wait_sema);
 
 	thread_exit();
 }
@@ -177,9 +243,7 @@ exec (const char *cmd_line)
 	if(!pointer_valid((void *) cmd_line))
 		exit(-1);
 
-	lock_acquire(&file_lock);
 	new_pid = process_execute(cmd_line);
-	lock_release(&file_lock);
 	// printf("PID: %d\n", new_pid);
 	return new_pid;
 }
@@ -208,9 +272,15 @@ create (const char *file, unsigned initial_size)
 	if(!pointer_valid((void *) file))
 		exit(-1);
 
+#ifdef VM
+	unsigned len = pin_string (file);
+#endif
 	lock_acquire(&file_lock);
 	success = filesys_create(file, initial_size);
 	lock_release(&file_lock);
+#ifdef VM
+	unpin_buffer (file, len);
+#endif
 	return success;
 }
 
@@ -226,9 +296,15 @@ remove (const char *file)
 	if(!pointer_valid((void *) file))
 		exit(-1);
 
+#ifdef VM
+	unsigned len = pin_string (file);
+#endif
 	lock_acquire(&file_lock);
 	success = filesys_remove(file);
 	lock_release(&file_lock);
+#ifdef VM
+	unpin_buffer (file, len);
+#endif
 	return success;
 }
 
@@ -252,21 +328,34 @@ open (const char *file)
 	if(!pointer_valid((void *) file))
 		exit(-1);
 
+#ifdef VM
+	unsigned len = pin_string (file);
+#endif
 	lock_acquire(&file_lock);
 	actual_file = filesys_open(file);
 	lock_release(&file_lock);
+#ifdef VM
+	unpin_buffer (file, len);
+#endif
 
 	//File cannot be opened, some error
 	if(!actual_file)
 		return -1;
 
-	//put the file pointer into the thread's file_list
+	//put the file pointer into the process's file_list
 	for(i = 2; i < MAX_FILES; i++)
-		if(!cur->file_list[i])
+		if(!cur->process->file_list[i])
 			break;
+	if(i == MAX_FILES)
+		{
+			lock_acquire(&file_lock);
+			file_close(actual_file);
+			lock_release(&file_lock);
+			return -1;
+		}
 	//insert the file into the position
 	fd = i;
-	cur->file_list[fd] = actual_file;
+	cur->process->file_list[fd] = actual_file;
 	return fd;
 }
 
@@ -307,6 +396,10 @@ read (int fd, void *buffer, unsigned size)
 	if(!pointer_valid(buffer) || !fd_valid(fd))
 		exit(-1);
 
+#ifdef VM
+	void *buffer_start = buffer;
+	pin_buffer (buffer_start, size, true);
+#endif
 	lock_acquire(&file_lock);
 	//Read from stdin
 	if(fd == STDIN_FILENO)
@@ -325,6 +418,9 @@ read (int fd, void *buffer, unsigned size)
 				bytes_read = file_read(fd_file, buffer, size);
 		}
 	lock_release(&file_lock);
+#ifdef VM
+	unpin_buffer (buffer_start, size);
+#endif
 
 	return bytes_read;
 }
@@ -346,6 +442,9 @@ write (int fd, const void *buffer, unsigned size)
 	if(!pointer_valid((void *) buffer) || !fd_valid(fd))
 		exit(-1);
 
+#ifdef VM
+	pin_buffer (buffer, size, false);
+#endif
 	lock_acquire(&file_lock);
 	if(fd == STDOUT_FILENO)
 		{
@@ -359,6 +458,9 @@ write (int fd, const void *buffer, unsigned size)
 				bytes_written = file_write(fd_file, buffer, size);
 		}
 	lock_release(&file_lock);
+#ifdef VM
+	unpin_buffer (buffer, size);
+#endif
 	return bytes_written;
 }
 
@@ -422,10 +524,135 @@ close (int fd)
 	file_close(fd_file);
 	lock_release(&file_lock);
 
-	cur->file_list[fd] = NULL;
+	cur->process->file_list[fd] = NULL;
 }
 //Siva stopped driving
 
+#ifdef VM
+/*Mmap system call - Maps the file open as fd into consecutive
+	pages starting at addr.  Nothing is read yet: each page is read
+	in from its own reopened copy of the file the first time it is
+	touched.  Fails if the file is empty, if addr is null or not
+	page-aligned, or if any of the pages is already in use.
+	Returns the new mapping's id, or MAP_FAILED.*/
+mapid_t
+mmap (int fd, void *addr)
+{
+	struct thread *cur = thread_current();
+	struct file *fd_file;
+	struct mapping *m;
+	off_t length, offset = 0;
+
+	if(!fd_valid(fd) || addr == NULL || pg_ofs(addr) != 0)
+		return MAP_FAILED;
+
+	m = malloc(sizeof *m);
+	if(!m)
+		return MAP_FAILED;
+
+	lock_acquire(&file_lock);
+	fd_file = fd_to_file(fd);
+	m->file = fd_file ? file_reopen(fd_file) : NULL;
+	length = m->file ? file_length(m->file) : 0;
+	lock_release(&file_lock);
+
+	if(!m->file || length == 0)
+		{
+			lock_acquire(&file_lock);
+			file_close(m->file);
+			lock_release(&file_lock);
+			free(m);
+			return MAP_FAILED;
+		}
+
+	m->handle = cur->process->next_mapid++;
+	m->base = addr;
+	m->page_cnt = 0;
+	list_push_front(&cur->process->mappings, &m->elem);
+
+	while(length > 0)
+		{
+			uint8_t *upage = m->base + offset;
+			struct page *p;
+
+			if(!is_user_vaddr(upage)
+				 || (p = page_allocate(upage, false)) == NULL)
+				{
+					unmap(m);
+					return MAP_FAILED;
+				}
+			p->private = false;
+			p->file = m->file;
+			p->file_offset = offset;
+			p->file_bytes = length >= PGSIZE ? PGSIZE : length;
+			offset += p->file_bytes;
+			length -= p->file_bytes;
+			m->page_cnt++;
+		}
+
+	return m->handle;
+}
+
+/*Munmap system call - Unmaps the given mapping, writing back the
+	pages that were modified.*/
+void
+munmap (mapid_t mapping)
+{
+	unmap(lookup_mapping(mapping));
+}
+
+/*Madvise system call - Passes a hint about how the process will use
+	the LENGTH bytes of memory at ADDR, which must be page-aligned, on
+	to the VM system.  Unmapped pages in the range are ignored.
+	Returns false if the range or ADVICE is invalid.*/
+bool
+madvise (void *addr, unsigned length, int advice)
+{
+	uint8_t *end = (uint8_t *) addr + length;
+	size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+	if(pg_ofs(addr) != 0 || end < (uint8_t *) addr
+		 || (length > 0 && !is_user_vaddr(end - 1)))
+		return false;
+
+	if(advice == MADV_NORMAL || advice == MADV_SEQUENTIAL)
+		page_set_sequential(addr, page_cnt, advice == MADV_SEQUENTIAL);
+	else if(advice == MADV_WILLNEED)
+		return prefetch_request(addr, page_cnt);
+	else if(advice == MADV_DONTNEED)
+		page_discard(addr, page_cnt);
+	else
+		return false;
+	return true;
+}
+#endif
+
+/*Schedstat system call - Fills in STATS with the time the calling
+	process has spent ready to run but not running and blocked, and
+	with the systemwide histogram of wakeup-to-run latency.  The
+	statistics are gathered into a local copy first, since they are
+	read with interrupts off.*/
+bool
+schedstat (struct schedstat *stats)
+{
+	struct schedstat s;
+
+	ASSERT (SCHEDSTAT_BUCKETS == LATENCY_BUCKETS);
+
+	if(!pointer_valid(stats) || !pointer_valid((uint8_t *) (stats + 1) - 1))
+		exit(-1);
+
+	thread_get_latency(&s.wait_cycles, &s.block_cycles, s.latency);
+#ifdef VM
+	pin_buffer (stats, sizeof *stats, true);
+#endif
+	memcpy(stats, &s, sizeof s);
+#ifdef VM
+	unpin_buffer (stats, sizeof *stats);
+#endif
+	return true;
+}
+
 /*Start of helper methods*/
 
 /*Checks the validity of a passed in user address. Can't 
@@ -437,8 +664,16 @@ pointer_valid (void * given_addr)
 	if(!(given_addr) || is_kernel_vaddr(given_addr))
 		return false;
 
+#ifdef VM
+	/* The page may not have been faulted in yet, so ask the
+		 supplemental page table instead of the page directory. */
+	if(!page_lock(given_addr, false))
+		return false;
+	page_unlock(given_addr);
+#else
 	if(!pagedir_get_page(thread_current()->pagedir, given_addr))
 		return false;
+#endif
 
 	return true;
 }
@@ -467,10 +702,122 @@ fd_to_file (int fd)
 
 	for(i = 2; i < MAX_FILES; i++)
 			if(fd == i)
-				fd_file = cur->file_list[i];
+				fd_file = cur->process->file_list[i];
 
 	return fd_file;
 }
 //Siva stopped driving
 
+#ifdef VM
+/*Returns the current thread's mapping with the given handle.
+	Kills the process if there is none.*/
+static struct mapping *
+lookup_mapping (int handle)
+{
+	struct thread *cur = thread_current();
+	struct list_elem *e;
+
+	for(e = list_begin(&cur->process->mappings); e != list_end(&cur->process->mappings);
+			e = list_next(e))
+		{
+			struct mapping *m = list_entry(e, struct mapping, elem);
+			if(m->handle == handle)
+				return m;
+		}
+
+	exit(-1);
+}
+
+/*Removes mapping M from the address space, writing back any
+	pages that were modified, and frees it.*/
+static void
+unmap (struct mapping *m)
+{
+	size_t i;
+
+	list_remove(&m->elem);
+	for(i = 0; i < m->page_cnt; i++)
+		page_deallocate(m->base + PGSIZE * i);
+
+	lock_acquire(&file_lock);
+	file_close(m->file);
+	lock_release(&file_lock);
+	free(m);
+}
+
+/*Unmaps all of the current process's memory-mapped files.
+	Called when the process exits.*/
+void
+syscall_exit (void)
+{
+	struct thread *cur = thread_current();
+
+	while(!list_empty(&cur->process->mappings))
+		unmap(list_entry(list_front(&cur->process->mappings), struct mapping, elem));
+}
+
+/*Locks the SIZE bytes of user memory at BUFFER into physical
+	memory, so that touching them with file_lock held can't page
+	fault.  If WILL_WRITE, the pages must be writable.  Kills the
+	process if any page is invalid.*/
+static void
+pin_buffer (const void *buffer, unsigned size, bool will_write)
+{
+	const uint8_t *start = pg_round_down (buffer);
+	const uint8_t *end = (const uint8_t *) buffer + size;
+	const uint8_t *upage;
+
+	if(size == 0)
+		return;
+	if(end < (const uint8_t *) buffer || !is_user_vaddr(end - 1))
+		exit(-1);
+
+	for(upage = start; upage < end; upage += PGSIZE)
+		if(!page_lock(upage, will_write))
+			{
+				unpin_buffer(start, upage - start);
+				exit(-1);
+			}
+}
+
+/*Unlocks memory locked with pin_buffer().*/
+static void
+unpin_buffer (const void *buffer, unsigned size)
+{
+	const uint8_t *start = pg_round_down (buffer);
+	const uint8_t *end = (const uint8_t *) buffer + size;
+	const uint8_t *upage;
+
+	if(size == 0)
+		return;
+	for(upage = start; upage < end; upage += PGSIZE)
+		page_unlock(upage);
+}
+
+/*Locks the null-terminated user string STR into physical memory
+	and returns its size, including the null terminator, for
+	unpin_buffer().  Kills the process if STR runs into an invalid
+	page.*/
+static unsigned
+pin_string (const char *str)
+{
+	const char *p = str;
+
+	for(;;)
+		{
+			if(!is_user_vaddr(p) || !page_lock(p, false))
+				{
+					unpin_buffer(str, p - str);
+					exit(-1);
+				}
+			/* Scan the rest of this page for the terminator. */
+			while(*p != '\0' && pg_ofs(p + 1) != 0)
+				p++;
+			if(*p == '\0')
+				return p - str + 1;
+			p++;
+		}
+}
+#endif
+
 /*End of helper methods*/
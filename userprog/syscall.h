@@ -1,7 +1,15 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
+/* Serializes all access to the file system. */
+extern struct lock file_lock;
+
 void syscall_init (void);
 void exit (int status);
+#ifdef VM
+void syscall_exit (void);
+#endif
 
 #endif /* userprog/syscall.h */
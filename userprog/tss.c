@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -72,35 +73,42 @@ struct tss
     uint16_t trace, bitmap;
   };
 
-/* Kernel TSS. */
-static struct tss *tss;
+/* Kernel TSSes, one per CPU, since each CPU switches to the
+   stack of the thread that it is running. */
+static struct tss *tss[CPU_MAX];
 
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSSes.  Must be called after
+   cpu_init(). */
 void
 tss_init (void) 
 {
+  unsigned i;
+
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
-  tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  tss->ss0 = SEL_KDSEG;
-  tss->bitmap = 0xdfff;
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      tss[i] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      tss[i]->ss0 = SEL_KDSEG;
+      tss[i]->bitmap = 0xdfff;
+    }
   tss_update ();
 }
 
-/* Returns the kernel TSS. */
+/* Returns the kernel TSS of the CPU with index CPU in cpus[]. */
 struct tss *
-tss_get (void) 
+tss_get (unsigned cpu) 
 {
-  ASSERT (tss != NULL);
-  return tss;
+  ASSERT (cpu < cpu_cnt && tss[cpu] != NULL);
+  return tss[cpu];
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to point
+   to the end of the thread stack. */
 void
 tss_update (void) 
 {
-  ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  struct tss *t = tss_get (cpu_current ()->id);
+  t->esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
@@ -0,0 +1,627 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+
+/* Frame table.
+
+   There is one entry for every physical page of RAM, indexed by
+   physical page number, although only entries for pages from the
+   user pool are ever used.  Entries are never freed, so a stale
+   pointer to a frame (for example, a page's `frame' member read
+   just before the frame was evicted) is always safe to lock and
+   re-check.
+
+   A frame that holds a page is on frame_list.  When the user pool
+   runs dry, the eviction policy picks frames to evict from the
+   list.  A frame is returned to the user pool as soon as its page
+   goes away, so the pool's free count is the number of free
+   frames. */
+static struct frame *frames;
+
+/* Frames in use.  New frames go at the back.  The front of the
+   list is the "hand" of the clock policy. */
+static struct list frame_list;
+
+/* Protects frame_list and the `age' of frames on it. */
+static struct lock scan_lock;
+
+/* Frames that hold read-only file data, keyed by inode, offset,
+   and length, so that every process that maps the same data can
+   share one copy.  A frame is in the table only while some page
+   uses it, and holds a reference to its inode so that the inode
+   cannot be freed and its address reused while the key exists. */
+static struct hash share_table;
+
+/* Protects share_table. */
+static struct lock share_lock;
+
+/* Statistics. */
+static long long evict_cnt;     /* Frames evicted. */
+static long long scan_cnt;      /* Frames examined by the policy. */
+static long long share_cnt;     /* Page faults satisfied by sharing. */
+
+/* An eviction policy.
+
+   PICK is called with scan_lock held.  It returns a frame from
+   frame_list that it has locked and removed from the list, or a
+   null pointer if it finds none.  If SWAP_ONLY is true, it must
+   only return a frame whose page would be written to swap. */
+struct evict_policy
+  {
+    const char *name;
+    struct frame *(*pick) (bool swap_only);
+  };
+
+static struct frame *pick_fifo (bool swap_only);
+static struct frame *pick_clock (bool swap_only);
+static struct frame *pick_aging (bool swap_only);
+
+/* Available eviction policies. */
+static const struct evict_policy policies[] =
+  {
+    {"fifo", pick_fifo},
+    {"clock", pick_clock},
+    {"aging", pick_aging},
+  };
+
+/* Policy in use.
+   Controlled by kernel command-line option "-evict=POLICY". */
+static const struct evict_policy *policy = &policies[1];
+
+/* Selects the eviction policy named NAME.
+   Returns true if successful, false if there is no such
+   policy. */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (name, policies[i].name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+  return false;
+}
+
+/* Returns a hash value for the shared frame that E refers to. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  return (hash_int ((uintptr_t) f->inode) ^ hash_int (f->offset)
+          ^ hash_int (f->bytes));
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  else if (a->offset != b->offset)
+    return a->offset < b->offset;
+  else
+    return a->bytes < b->bytes;
+}
+
+/* Initialize the frame manager. */
+void
+frame_init (void)
+{
+  size_t i;
+
+  lock_init (&scan_lock);
+  list_init (&frame_list);
+  lock_init (&share_lock);
+  hash_init (&share_table, share_hash, share_less, NULL);
+
+  frames = malloc (sizeof *frames * init_ram_pages);
+  if (frames == NULL)
+    PANIC ("out of memory allocating page frames");
+  for (i = 0; i < init_ram_pages; i++)
+    {
+      struct frame *f = &frames[i];
+      lock_init (&f->lock);
+      f->base = NULL;
+      f->page = NULL;
+      f->age = 0;
+      f->inode = NULL;
+      f->checksum = 0;
+    }
+}
+
+/* Removes frame F, which must be locked, from the share table if
+   it is there. */
+static void
+unpublish_frame (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (f->inode != NULL)
+    {
+      struct inode *inode = f->inode;
+
+      lock_acquire (&share_lock);
+      hash_delete (&share_table, &f->share_elem);
+      lock_release (&share_lock);
+      f->inode = NULL;
+
+      lock_acquire (&file_lock);
+      inode_close (inode);
+      lock_release (&file_lock);
+    }
+}
+
+/* Sets up the frame for the free user pool page at BASE to hold
+   PAGE and returns it, locked.  Returns a null pointer if BASE is
+   null. */
+static struct frame *
+claim_frame (void *base, struct page *page)
+{
+  struct frame *f;
+
+  if (base == NULL)
+    return NULL;
+
+  /* If BASE was just freed by frame_free(), that thread may still
+     hold the lock, briefly. */
+  f = &frames[vtop (base) >> PGBITS];
+  lock_acquire (&f->lock);
+  f->base = base;
+  f->page = page;
+
+  lock_acquire (&scan_lock);
+  f->age = 0;
+  list_push_back (&frame_list, &f->elem);
+  lock_release (&scan_lock);
+  return f;
+}
+
+/* Puts frame F, which the caller has locked and removed from
+   frame_list, back at the end of the list. */
+static void
+requeue_frame (struct frame *f)
+{
+  lock_acquire (&scan_lock);
+  list_push_back (&frame_list, &f->elem);
+  lock_release (&scan_lock);
+}
+
+/* Tries to lock frame F, which is on frame_list, as an eviction
+   candidate.  If SWAP_ONLY is true, F must also hold a page that
+   would be written to swap.  Returns true if F is now locked. */
+static bool
+try_lock_victim (struct frame *f, bool swap_only)
+{
+  scan_cnt++;
+
+  /* Skip frames that are pinned or being paged in or out,
+     including any that we hold ourselves. */
+  if (lock_held_by_current_thread (&f->lock)
+      || !lock_try_acquire (&f->lock))
+    return false;
+
+  if (swap_only && !page_swap_backed (f->page))
+    {
+      lock_release (&f->lock);
+      return false;
+    }
+  return true;
+}
+
+/* Moves frame F from wherever it is in frame_list to the back,
+   past the clock hand. */
+static void
+rotate_frame (struct frame *f)
+{
+  list_remove (&f->elem);
+  list_push_back (&frame_list, &f->elem);
+}
+
+/* FIFO policy: evicts the frame that was filled longest ago,
+   ignoring how it has been used since. */
+static struct frame *
+pick_fifo (bool swap_only)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (try_lock_victim (f, swap_only))
+        {
+          list_remove (&f->elem);
+          return f;
+        }
+    }
+  return NULL;
+}
+
+/* Clock (second chance) policy.  The hand sweeps from the front
+   of frame_list; every frame it passes moves to the back.  A frame
+   whose page has been accessed since the hand last passed it has
+   its accessed bit cleared and is passed over.  On its first
+   revolution the hand also passes over pages that would need to
+   be written out, so that a clean page is preferred when there is
+   one. */
+static struct frame *
+pick_clock (bool swap_only)
+{
+  size_t frame_cnt = list_size (&frame_list);
+  size_t step;
+
+  /* Completing the search for cluster members is not worth
+     clearing every accessed bit, so give them one revolution. */
+  size_t max_steps = swap_only ? frame_cnt : 2 * frame_cnt;
+
+  for (step = 0; step < max_steps; step++)
+    {
+      struct frame *f = list_entry (list_front (&frame_list),
+                                    struct frame, elem);
+
+      if (try_lock_victim (f, swap_only))
+        {
+          bool skip = page_accessed_recently (f->page)
+                      || (!swap_only && step < frame_cnt
+                          && page_needs_write (f->page));
+          if (!skip)
+            {
+              list_remove (&f->elem);
+              return f;
+            }
+          lock_release (&f->lock);
+        }
+      rotate_frame (f);
+    }
+
+  /* Every page is in active use.  Take the oldest. */
+  return swap_only ? NULL : pick_fifo (false);
+}
+
+/* Aging policy, an approximation of LRU.  Each frame has an 8-bit
+   age.  On every eviction, each frame's age is shifted right and
+   its page's accessed bit, which is then cleared, is shifted in at
+   the top.  The frame with the smallest age, which has gone
+   longest without being used, is evicted, preferring a page that
+   needs no writing on a tie. */
+static struct frame *
+pick_aging (bool swap_only)
+{
+  struct frame *best = NULL;
+  bool best_needs_write = false;
+  struct list_elem *e;
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      bool needs_write;
+
+      if (!try_lock_victim (f, swap_only))
+        continue;
+
+      /* Picking cluster members shouldn't age the frames any
+         faster than one tick per eviction. */
+      if (!swap_only)
+        f->age = (f->age >> 1) | (page_accessed_recently (f->page) ? 0x80 : 0);
+
+      needs_write = page_needs_write (f->page);
+      if (best == NULL
+          || f->age < best->age
+          || (f->age == best->age && best_needs_write && !needs_write))
+        {
+          if (best != NULL)
+            lock_release (&best->lock);
+          best = f;
+          best_needs_write = needs_write;
+        }
+      else
+        lock_release (&f->lock);
+    }
+
+  if (best != NULL)
+    list_remove (&best->elem);
+  return best;
+}
+
+/* Evicts frames chosen by the eviction policy and returns one of
+   them, still locked, for PAGE to use.
+
+   If the first victim's page has to be written to swap, up to
+   SWAP_CLUSTER_PAGES - 1 more swap-bound victims are evicted
+   along with it, so that all of them go out in one sequential
+   burst to the swap device.  The extra frames are returned to the
+   user pool, where the next few allocations will find them
+   without another round of eviction.
+
+   Returns a null pointer if nothing could be evicted. */
+static struct frame *
+evict_frame (struct page *page)
+{
+  struct frame *victims[SWAP_CLUSTER_PAGES];
+  struct page *pages[SWAP_CLUSTER_PAGES];
+  struct frame *f = NULL;
+  size_t victim_cnt = 0;
+  size_t i;
+
+  lock_acquire (&scan_lock);
+  while (victim_cnt < SWAP_CLUSTER_PAGES)
+    {
+      struct frame *v = policy->pick (victim_cnt > 0);
+      if (v == NULL)
+        break;
+
+      victims[victim_cnt] = v;
+      pages[victim_cnt] = v->page;
+      victim_cnt++;
+
+      /* Only swap-bound pages are worth clustering with a
+         swap-bound first victim. */
+      if (!page_swap_backed (v->page))
+        break;
+    }
+  lock_release (&scan_lock);
+
+  page_out_cluster (pages, victim_cnt);
+
+  for (i = 0; i < victim_cnt; i++)
+    {
+      struct frame *v = victims[i];
+
+      if (pages[i]->frame != NULL)
+        {
+          /* Couldn't evict this one. */
+          requeue_frame (v);
+          lock_release (&v->lock);
+        }
+      else if (f == NULL)
+        {
+          /* Reuse the first evicted frame for PAGE. */
+          evict_cnt++;
+          unpublish_frame (v);
+          f = v;
+          f->page = page;
+          f->age = 0;
+          requeue_frame (f);
+        }
+      else
+        {
+          /* Give the rest back to the user pool. */
+          evict_cnt++;
+          unpublish_frame (v);
+          palloc_free_page (v->base);
+          v->base = NULL;
+          v->page = NULL;
+          lock_release (&v->lock);
+        }
+    }
+  return f;
+}
+
+/* Allocates and locks a frame for PAGE, from the user pool if
+   it has a free page or else by evicting once, without waiting
+   for busy frames.  If ZERO is true, the frame is filled with
+   zeros; a page that the idle thread zeroed ahead of time is used
+   if one is available.  Returns the frame if successful, a null
+   pointer on failure. */
+struct frame *
+frame_try_alloc_and_lock (struct page *page, bool zero)
+{
+  struct frame *f = claim_frame (palloc_get_page (PAL_USER
+                                                  | (zero ? PAL_ZERO : 0)),
+                                 page);
+  if (f == NULL)
+    {
+      f = evict_frame (page);
+      if (f != NULL && zero)
+        memset (f->base, 0, PGSIZE);
+    }
+  ASSERT (f == NULL || lock_held_by_current_thread (&f->lock));
+  return f;
+}
+
+/* Tries really hard to allocate and lock a frame for PAGE, as
+   frame_try_alloc_and_lock() does, but waits and tries again
+   if every frame is busy.
+   Returns the frame if successful, a null pointer on failure. */
+struct frame *
+frame_alloc_and_lock (struct page *page, bool zero)
+{
+  size_t try;
+
+  for (try = 0; try < 3; try++)
+    {
+      struct frame *f = frame_try_alloc_and_lock (page, zero);
+      if (f != NULL)
+        return f;
+
+      /* Every frame is busy.  Give the other processes a chance
+         to finish what they are doing with them. */
+      timer_msleep (1000);
+    }
+
+  return NULL;
+}
+
+/* Locks P's frame into memory, if it has one.
+   Upon return, p->frame will not change until P is unlocked. */
+void
+frame_lock (struct page *p)
+{
+  /* A frame can be asynchronously removed, or replaced by the
+     frame that ksm.c merged it into, but never inserted. */
+  for (;;)
+    {
+      struct frame *f = p->frame;
+      if (f == NULL)
+        return;
+
+      lock_acquire (&f->lock);
+      if (f == p->frame)
+        return;
+      lock_release (&f->lock);
+    }
+}
+
+/* Returns the number of entries in the frame table. */
+size_t
+frame_table_size (void)
+{
+  return init_ram_pages;
+}
+
+/* Tries to lock entry IDX in the frame table without waiting.
+   Returns the frame, locked, if it holds a page and was not
+   busy, otherwise a null pointer. */
+struct frame *
+frame_try_lock_at (size_t idx)
+{
+  struct frame *f;
+
+  ASSERT (idx < init_ram_pages);
+
+  f = &frames[idx];
+  if (f->page == NULL || !lock_try_acquire (&f->lock))
+    return NULL;
+  if (f->page == NULL)
+    {
+      lock_release (&f->lock);
+      return NULL;
+    }
+  return f;
+}
+
+/* Releases frame F for use by another page and returns it to the
+   user pool.
+   F must be locked for use by the current process.
+   Any data in F is lost. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  unpublish_frame (f);
+
+  lock_acquire (&scan_lock);
+  list_remove (&f->elem);
+  lock_release (&scan_lock);
+
+  palloc_free_page (f->base);
+  f->base = NULL;
+  f->page = NULL;
+  lock_release (&f->lock);
+}
+
+/* Looks for a frame that holds BYTES bytes of read-only data from
+   INODE starting at OFFSET.  Returns the frame, locked, if there
+   is one, otherwise a null pointer. */
+struct frame *
+frame_lookup_shared (struct inode *inode, off_t offset, off_t bytes)
+{
+  struct frame key;
+  struct frame *f = NULL;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.offset = offset;
+  key.bytes = bytes;
+  lock_acquire (&share_lock);
+  e = hash_find (&share_table, &key.share_elem);
+  if (e != NULL)
+    f = hash_entry (e, struct frame, share_elem);
+  lock_release (&share_lock);
+
+  if (f != NULL)
+    {
+      /* The frame may have been evicted or freed, and perhaps
+         reused, since we found it. */
+      lock_acquire (&f->lock);
+      if (f->inode != inode || f->offset != offset || f->bytes != bytes)
+        {
+          lock_release (&f->lock);
+          return NULL;
+        }
+      share_cnt++;
+    }
+  return f;
+}
+
+/* Makes frame F, which must be locked and hold BYTES bytes of
+   read-only data from INODE starting at OFFSET, available to
+   frame_lookup_shared().  Does nothing if another frame already
+   holds the same data. */
+void
+frame_publish (struct frame *f, struct inode *inode, off_t offset,
+               off_t bytes)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->offset = offset;
+  f->bytes = bytes;
+  lock_acquire (&share_lock);
+  if (hash_insert (&share_table, &f->share_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&share_lock);
+
+  if (f->inode != NULL)
+    {
+      lock_acquire (&file_lock);
+      inode_reopen (inode);
+      lock_release (&file_lock);
+    }
+}
+
+/* Makes frame F, which must be locked and hold a page, the next
+   to be evicted: moves it to the front of frame_list, where both
+   the FIFO policy and the clock hand start, and clears its age
+   for the aging policy.  The caller should clear the accessed
+   bits of F's pages, too. */
+void
+frame_deactivate (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->page != NULL);
+
+  lock_acquire (&scan_lock);
+  list_remove (&f->elem);
+  list_push_front (&frame_list, &f->elem);
+  f->age = 0;
+  lock_release (&scan_lock);
+}
+
+/* Unlocks frame F, allowing it to be evicted.
+   F must be locked for use by the current process. */
+void
+frame_unlock (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
+
+/* Prints frame statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evicted, %lld examined by %s policy, "
+          "%lld shared\n", evict_cnt, scan_cnt, policy->name, share_cnt);
+}
@@ -0,0 +1,51 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+/* A physical frame. */
+struct frame
+  {
+    struct lock lock;           /* Prevent simultaneous access. */
+    void *base;                 /* Kernel virtual base address. */
+    struct page *page;          /* Mapped process page, if any.
+                                   Other pages sharing the frame
+                                   follow on its `next_sharer'. */
+    struct list_elem elem;      /* Element in frame_list. */
+    uint8_t age;                /* Recent use, for the aging policy. */
+
+    /* Shared read-only file data, protected by lock. */
+    struct inode *inode;        /* Inode, or null if not shared. */
+    off_t offset;               /* Offset in inode. */
+    off_t bytes;                /* Bytes of data from inode. */
+    struct hash_elem share_elem; /* Element in share table. */
+
+    /* Used only by the same-page merging thread in ksm.c. */
+    unsigned checksum;          /* Hash of contents at last scan. */
+    struct hash_elem ksm_elem;  /* Element in ksm.c's scan table. */
+  };
+
+void frame_init (void);
+bool frame_set_policy (const char *name);
+void frame_print_stats (void);
+
+struct frame *frame_alloc_and_lock (struct page *, bool zero);
+struct frame *frame_try_alloc_and_lock (struct page *, bool zero);
+void frame_lock (struct page *);
+size_t frame_table_size (void);
+struct frame *frame_try_lock_at (size_t idx);
+struct frame *frame_lookup_shared (struct inode *, off_t offset,
+                                   off_t bytes);
+void frame_publish (struct frame *, struct inode *, off_t offset,
+                    off_t bytes);
+void frame_deactivate (struct frame *);
+
+void frame_free (struct frame *);
+void frame_unlock (struct frame *);
+
+#endif /* vm/frame.h */
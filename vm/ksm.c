@@ -0,0 +1,154 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "devices/timer.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+
+/* Kernel same-page merging.
+
+   When many processes run the same program, many of their data,
+   heap, and stack pages hold identical bytes.  A work item on
+   system_wq periodically scans the frame table, hashes the contents
+   of every frame that holds private, writable memory, and merges
+   frames with identical contents into one.  The pages that used
+   the merged frames then share the survivor, mapped read-only;
+   the first write to one of them gives it a private copy again
+   (see page.c).
+
+   A frame is only considered if its hash has not changed since
+   the previous scan, so that pages that are being actively
+   written, which would just be copied again, are left alone. */
+
+/* Time between scans, in timer ticks. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+
+/* Frames found stable in the current scan, keyed by checksum. */
+static struct hash scan_table;
+
+/* Scans the frame table, then queues itself to run again. */
+static struct work scan_work;
+
+/* Time at which scanning started, in timer ticks. */
+static int64_t start_time;
+
+/* Statistics. */
+static bool ksm_running;        /* Is scanning enabled? */
+static long long pass_cnt;      /* Scans of the frame table. */
+static long long merge_cnt;     /* Frames reclaimed by merging. */
+
+static work_func scan_work_func;
+static void scan_frames (void);
+
+/* Returns a hash value for the frame that E refers to. */
+static unsigned
+scan_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, ksm_elem);
+  return hash_int (f->checksum);
+}
+
+/* Returns true if frame A's checksum is less than frame B's. */
+static bool
+scan_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+  const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+
+  return a->checksum < b->checksum;
+}
+
+/* Starts periodic same-page merging. */
+void
+ksm_init (void)
+{
+  hash_init (&scan_table, scan_hash, scan_less, NULL);
+  start_time = timer_ticks ();
+  ksm_running = true;
+  work_init (&scan_work, scan_work_func, NULL);
+  queue_delayed_work (system_wq, &scan_work, KSM_INTERVAL);
+}
+
+/* Prints same-page merging statistics. */
+void
+ksm_print_stats (void)
+{
+  int64_t elapsed;
+
+  if (!ksm_running)
+    return;
+  elapsed = timer_elapsed (start_time);
+  printf ("KSM: %lld frames reclaimed in %lld scans, %lld per minute\n",
+          merge_cnt, pass_cnt,
+          elapsed > 0 ? merge_cnt * 60 * TIMER_FREQ / elapsed : 0);
+}
+
+/* Work function for scan_work.  Scans the frame table once and
+   schedules the next scan.  A work item never runs in two workers
+   at once, so scan_table needs no lock. */
+static void
+scan_work_func (void *aux UNUSED)
+{
+  scan_frames ();
+  pass_cnt++;
+  queue_delayed_work (system_wq, &scan_work, KSM_INTERVAL);
+}
+
+/* Scans the frame table once, merging each stable frame into an
+   earlier frame in the same scan with identical contents, if
+   there is one.  Frames that are busy are skipped until the next
+   scan. */
+static void
+scan_frames (void)
+{
+  size_t i;
+
+  hash_clear (&scan_table, NULL);
+  for (i = 0; i < frame_table_size (); i++)
+    {
+      struct frame *f = frame_try_lock_at (i);
+      struct hash_elem *e;
+      unsigned checksum;
+
+      if (f == NULL)
+        continue;
+      if (!page_mergeable (f->page))
+        {
+          frame_unlock (f);
+          continue;
+        }
+
+      checksum = hash_bytes (f->base, PGSIZE);
+      if (checksum != f->checksum)
+        {
+          /* Changed since the last scan.  Check again next time. */
+          f->checksum = checksum;
+          frame_unlock (f);
+          continue;
+        }
+
+      e = hash_insert (&scan_table, &f->ksm_elem);
+      if (e != NULL)
+        {
+          /* An earlier frame had the same checksum.  It may have
+             been freed or reused since, so check it again. */
+          struct frame *a = hash_entry (e, struct frame, ksm_elem);
+          if (lock_try_acquire (&a->lock))
+            {
+              bool merged = (a->page != NULL && page_mergeable (a->page)
+                             && page_merge (a, f));
+              frame_unlock (a);
+              if (merged)
+                {
+                  merge_cnt++;
+                  continue;
+                }
+            }
+        }
+      frame_unlock (f);
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+void ksm_init (void);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
@@ -0,0 +1,1062 @@
+#include "vm/page.h"
+#include <stdio.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+
+/* Maximum size of process stack, in bytes. */
+#define STACK_MAX (1024 * 1024)
+
+/* Bounds on the read-ahead window, in pages.  See
+   fault_around(). */
+#define READ_AHEAD_MIN 1
+#define READ_AHEAD_MAX 16
+
+/* In a range advised MADV_SEQUENTIAL, pages at least this many
+   pages behind a fault are taken to be done with.  See
+   drop_behind(). */
+#define DROP_BEHIND_DISTANCE READ_AHEAD_MAX
+
+/* A page of zeros, mapped read-only into every process at each
+   zero-fill page that has been read but never written.  The first
+   write to such a page faults and gives it a frame of its own. */
+static void *zero_page;
+
+/* Pages read ahead of a fault are read from their file into this
+   buffer all at once, then copied into their frames.  Guarded by
+   file_lock.  See read_ahead(). */
+static uint8_t *read_ahead_buffer;
+
+/* Statistics. */
+static long long zero_map_cnt;  /* Read faults given the zero page. */
+static long long zero_copy_cnt; /* Write faults on the zero page. */
+static long long cow_cnt;       /* Writes that unmerged a page. */
+static long long dropped_cnt;   /* Frames dropped behind a scan. */
+static long long released_cnt;  /* Frames released by MADV_DONTNEED. */
+
+/* Initializes the page module. */
+void
+page_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  read_ahead_buffer = palloc_get_multiple (PAL_ASSERT, READ_AHEAD_MAX - 1);
+}
+
+/* Prints zero page statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Zero page: %lld read faults mapped it, "
+          "%lld write faults replaced it\n", zero_map_cnt, zero_copy_cnt);
+  printf ("Merged pages: %lld copied on write\n", cow_cnt);
+  printf ("Advice: %lld frames dropped behind sequential scans, "
+          "%lld released\n", dropped_cnt, released_cnt);
+}
+
+/* Returns true if page P belongs in the zero page, that is, if it
+   has never been written and so has no data anywhere, false
+   otherwise. */
+static bool
+page_zero_fill (const struct page *p)
+{
+  return p->sector == (block_sector_t) -1 && p->file == NULL;
+}
+
+/* Returns true if page P is currently mapped to the zero page. */
+static bool
+maps_zero_page (const struct page *p)
+{
+  return pagedir_get_page (p->thread->pagedir, p->addr) == zero_page;
+}
+
+/* Maps page P, which must be a zero-fill page without a frame, to
+   the zero page, if it isn't already.
+   Returns true if successful, false on failure. */
+static bool
+map_zero_page (struct page *p)
+{
+  ASSERT (p->frame == NULL && page_zero_fill (p));
+  if (maps_zero_page (p))
+    return true;
+  zero_map_cnt++;
+  return pagedir_set_page (p->thread->pagedir, p->addr, zero_page, false);
+}
+
+/* Removes page P, which must hold frame F locked, from the list
+   of pages sharing F. */
+static void
+unlink_sharer (struct frame *f, struct page *p)
+{
+  struct page **pp;
+
+  for (pp = &f->page; *pp != p; pp = &(*pp)->next_sharer)
+    ASSERT (*pp != NULL);
+  *pp = p->next_sharer;
+  p->next_sharer = NULL;
+}
+
+/* Releases page P's frame or swap slot.  If P is a memory-mapped
+   page that has been written, it is first written back to its
+   file.  Other pages sharing P's frame keep the frame.  P must be
+   in the current process's page table. */
+static void
+release_page (struct page *p)
+{
+  frame_lock (p);
+  if (p->frame != NULL)
+    {
+      struct frame *f = p->frame;
+      uint32_t *pd = p->thread->pagedir;
+
+      pagedir_clear_page (pd, p->addr);
+      if (p->file != NULL && !p->private && pagedir_is_dirty (pd, p->addr))
+        {
+          lock_acquire (&file_lock);
+          file_write_at (p->file, f->base, p->file_bytes, p->file_offset);
+          lock_release (&file_lock);
+        }
+
+      p->frame = NULL;
+      if (f->page == p && p->next_sharer == NULL)
+        frame_free (f);
+      else
+        {
+          unlink_sharer (f, p);
+          frame_unlock (f);
+        }
+    }
+  else if (maps_zero_page (p))
+    pagedir_clear_page (p->thread->pagedir, p->addr);
+  swap_discard (p);
+}
+
+/* Destroys a page, which must be in the current process's
+   page table.  Used as a callback for hash_destroy(). */
+static void
+destroy_page (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+  release_page (p);
+  free (p);
+}
+
+/* Destroys the current process's page table. */
+void
+page_exit (void)
+{
+  struct process *proc = thread_current ()->process;
+  struct hash *h = proc->pages;
+  if (h != NULL)
+    {
+      prefetch_cancel ();
+      proc->pages = NULL;
+      hash_destroy (h, destroy_page);
+      free (h);
+    }
+}
+
+/* Returns the current process's page containing ADDRESS, or a
+   null pointer if there is none. */
+static struct page *
+find_page (const void *address)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.addr = (void *) pg_round_down (address);
+  e = hash_find (thread_current ()->process->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns the page containing the given virtual ADDRESS,
+   or a null pointer if no such page exists.
+   Allocates stack pages as necessary. */
+static struct page *
+page_for_addr (const void *address)
+{
+  struct process *proc = thread_current ()->process;
+
+  if (address < PHYS_BASE)
+    {
+      /* Find existing page. */
+      struct page *p = find_page (address);
+      if (p != NULL)
+        return p;
+
+      /* No page.  Expand stack?  PUSHA can fault as much as 32
+         bytes below the stack pointer. */
+      if (address >= PHYS_BASE - STACK_MAX
+          && address >= proc->user_esp - 32)
+        return page_allocate ((void *) address, false);
+    }
+  return NULL;
+}
+
+/* Returns true if page P holds read-only data from a file, which
+   other processes that map the same data can share. */
+static bool
+page_shareable (const struct page *p)
+{
+  return p->read_only && p->file != NULL;
+}
+
+/* If some other page's frame already holds shareable page P's
+   data, locks that frame and makes P share it.
+   Returns true if successful, false if there is no such frame. */
+static bool
+share_frame (struct page *p)
+{
+  struct frame *f;
+
+  if (!page_shareable (p))
+    return false;
+
+  f = frame_lookup_shared (file_get_inode (p->file), p->file_offset,
+                           p->file_bytes);
+  if (f == NULL)
+    return false;
+
+  p->frame = f;
+  p->next_sharer = f->page->next_sharer;
+  f->page->next_sharer = p;
+  return true;
+}
+
+/* Locks a new frame for page P and reads P's data into it.  If
+   MAY_WAIT is false, gives up instead of waiting for a frame
+   when every frame is busy.
+   Returns true if successful, false on failure, including when
+   P's file yields fewer bytes than P needs.  On failure, P is
+   left without a frame. */
+static bool
+load_frame (struct page *p, bool may_wait)
+{
+  /* Get a frame for the page, already zeroed if the page is to
+     be all zeros. */
+  bool zero = p->sector == (block_sector_t) -1 && p->file == NULL;
+  p->frame = (may_wait
+              ? frame_alloc_and_lock (p, zero)
+              : frame_try_alloc_and_lock (p, zero));
+  if (p->frame == NULL)
+    return false;
+
+  /* Copy data into the frame. */
+  if (p->sector != (block_sector_t) -1)
+    {
+      /* Get data from swap. */
+      swap_in (p);
+    }
+  else if (p->file != NULL)
+    {
+      /* Get data from file. */
+      off_t read_bytes;
+
+      lock_acquire (&file_lock);
+      read_bytes = file_read_at (p->file, p->frame->base,
+                                 p->file_bytes, p->file_offset);
+      lock_release (&file_lock);
+      if (read_bytes != p->file_bytes)
+        {
+          /* The file has shrunk or could not be read.  Handing
+             the process a page of zeros would hide that. */
+          struct frame *f = p->frame;
+          p->frame = NULL;
+          frame_free (f);
+          return false;
+        }
+      memset (p->frame->base + read_bytes, 0, PGSIZE - read_bytes);
+      if (page_shareable (p))
+        frame_publish (p->frame, file_get_inode (p->file),
+                       p->file_offset, p->file_bytes);
+    }
+
+  return true;
+}
+
+/* Locks a frame for page P and pages it in.
+   Returns true if successful, false on failure. */
+static bool
+do_page_in (struct page *p)
+{
+  /* Use a frame that already holds the data, if there is one. */
+  return share_frame (p) || load_frame (p, true);
+}
+
+/* Returns true if page P, whose frame must be locked, shares its
+   frame with any other page. */
+static bool
+frame_shared (const struct page *p)
+{
+  return p->frame->page != p || p->next_sharer != NULL;
+}
+
+/* Maps P's frame, which must be locked, into the page table if it
+   is not already there.  A frame that P shares with other pages
+   is mapped read-only, so that writing it faults.  Returns true
+   if successful, false if memory for a page table could not be
+   allocated. */
+static bool
+map_page (struct page *p)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  if (maps_zero_page (p))
+    pagedir_clear_page (t->pagedir, p->addr);
+  else if (pagedir_get_page (t->pagedir, p->addr) != NULL)
+    return true;
+  return pagedir_set_page (t->pagedir, p->addr, p->frame->base,
+                           !p->read_only && !frame_shared (p));
+}
+
+/* Prepares page P, whose frame must be locked, to be written.  If
+   P shares its frame with pages merged by ksm.c, P gets a copy of
+   its own, which is returned locked in place of the shared frame.
+   Either way, P is unmapped, so that map_page() maps it again
+   writable.  Returns true if successful, false if no frame could
+   be allocated for the copy, in which case P keeps the shared
+   frame. */
+static bool
+unshare_page (struct page *p)
+{
+  struct frame *shared = p->frame;
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&shared->lock));
+  ASSERT (!p->read_only);
+
+  if (!frame_shared (p))
+    {
+      if (!pagedir_is_writable (p->thread->pagedir, p->addr))
+        pagedir_clear_page (p->thread->pagedir, p->addr);
+      return true;
+    }
+
+  f = frame_alloc_and_lock (p, false);
+  if (f == NULL)
+    return false;
+  memcpy (f->base, shared->base, PGSIZE);
+
+  pagedir_clear_page (p->thread->pagedir, p->addr);
+  unlink_sharer (shared, p);
+  p->frame = f;
+  frame_unlock (shared);
+  cow_cnt++;
+  return true;
+}
+
+/* Reads the data for the RUN_CNT pages in RUN, which are
+   consecutive pages of one file, each with a new frame that the
+   caller has locked.  The whole run is read from the file at
+   once, which inode_read_at() passes to the disk as a single
+   block_read_multiple() request, instead of one request per page.
+   Then maps the pages and unlocks their frames.  Pages whose data
+   could not all be read get no frame.
+   Returns the number of pages at the start of RUN that were read
+   and mapped. */
+static size_t
+read_ahead (struct page *run[], size_t run_cnt)
+{
+  struct page *first = run[0];
+  struct page *last = run[run_cnt - 1];
+  off_t read_bytes;
+  size_t mapped_cnt = 0;
+  bool read_ok[READ_AHEAD_MAX];
+  size_t i;
+
+  lock_acquire (&file_lock);
+  read_bytes = file_read_at (first->file, read_ahead_buffer,
+                             last->file_offset + last->file_bytes
+                             - first->file_offset,
+                             first->file_offset);
+  for (i = 0; i < run_cnt; i++)
+    {
+      struct page *q = run[i];
+      off_t ofs = q->file_offset - first->file_offset;
+
+      read_ok[i] = ofs + q->file_bytes <= read_bytes;
+      if (read_ok[i])
+        {
+          memcpy (q->frame->base, read_ahead_buffer + ofs, q->file_bytes);
+          memset (q->frame->base + q->file_bytes, 0,
+                  PGSIZE - q->file_bytes);
+        }
+    }
+  lock_release (&file_lock);
+
+  for (i = 0; i < run_cnt; i++)
+    {
+      struct page *q = run[i];
+      struct frame *f = q->frame;
+
+      if (!read_ok[i])
+        {
+          q->frame = NULL;
+          frame_free (f);
+          continue;
+        }
+      if (page_shareable (q))
+        frame_publish (f, file_get_inode (q->file), q->file_offset,
+                       q->file_bytes);
+      q->read_ahead = true;
+      if (mapped_cnt == i && map_page (q))
+        mapped_cnt++;
+      frame_unlock (f);
+    }
+  return mapped_cnt;
+}
+
+/* Called after a fault has read file page P in from its file,
+   with P's frame still locked.  Maps the pages that follow P in
+   the same file along with it, so that a process reading through
+   a file sequentially takes one fault per batch of pages instead
+   of one per page.  Following pages that are already in memory
+   are mapped, up to READ_AHEAD_MAX - 1 of them.  Those that must
+   be read from the file are read ahead only within the current
+   read-ahead window, each run of them with a single read.
+
+   The window doubles each time the process faults just past the
+   pages brought in by the previous fault, which means it used
+   them all, and drops back to READ_AHEAD_MIN on a fault anywhere
+   else.  page_out_cluster() halves it when it evicts a page that
+   was read ahead but never used. */
+static void
+fault_around (struct page *p)
+{
+  struct process *proc = thread_current ()->process;
+  struct page *run[READ_AHEAD_MAX];
+  size_t run_cnt = 0;
+  size_t i;
+
+  if (p->sequential)
+    proc->ra_window = READ_AHEAD_MAX;
+  else if (p->addr == proc->ra_next)
+    proc->ra_window = (proc->ra_window * 2 < READ_AHEAD_MAX
+                    ? proc->ra_window * 2 : READ_AHEAD_MAX);
+  else
+    proc->ra_window = READ_AHEAD_MIN;
+
+  for (i = 1; i < READ_AHEAD_MAX; i++)
+    {
+      uint8_t *addr = (uint8_t *) p->addr + i * PGSIZE;
+      off_t offset = p->file_offset + (off_t) i * PGSIZE;
+      struct page *q;
+
+      if (!is_user_vaddr (addr))
+        break;
+      q = find_page (addr);
+      if (q == NULL || q->file != p->file || q->file_offset != offset
+          || q->sector != (block_sector_t) -1)
+        break;
+
+      frame_lock (q);
+      if (q->frame == NULL && !share_frame (q))
+        {
+          /* Reading ahead must not hold up the fault on P, which
+             still holds P's frame and page_in_lock, so it gives
+             up rather than wait for a frame.  Q's data is read
+             along with the rest of its run, by read_ahead(). */
+          if (i >= proc->ra_window
+              || (q->frame = frame_try_alloc_and_lock (q, false)) == NULL)
+            break;
+          run[run_cnt++] = q;
+          continue;
+        }
+
+      /* Q is already in memory, which ends the run of pages
+         before it that need reading. */
+      if (run_cnt > 0)
+        {
+          size_t read_cnt = read_ahead (run, run_cnt);
+          if (read_cnt < run_cnt)
+            {
+              frame_unlock (q->frame);
+              i -= run_cnt - read_cnt;
+              run_cnt = 0;
+              break;
+            }
+          run_cnt = 0;
+        }
+      if (!map_page (q))
+        {
+          frame_unlock (q->frame);
+          break;
+        }
+      frame_unlock (q->frame);
+    }
+  if (run_cnt > 0)
+    i -= run_cnt - read_ahead (run, run_cnt);
+
+  proc->ra_next = (uint8_t *) p->addr + i * PGSIZE;
+}
+
+/* Called after a fault on page P in a range that the process has
+   said it will scan sequentially.  Pages DROP_BEHIND_DISTANCE or
+   more pages behind P have presumably been used for the last
+   time, so their frames are made the next to be evicted, ahead of
+   other processes' working sets.  Frames that are busy are left
+   alone. */
+static void
+drop_behind (struct page *p)
+{
+  size_t i;
+
+  for (i = DROP_BEHIND_DISTANCE; i < DROP_BEHIND_DISTANCE + READ_AHEAD_MAX;
+       i++)
+    {
+      uint8_t *addr = (uint8_t *) p->addr - i * PGSIZE;
+      struct page *q;
+      struct frame *f;
+
+      if (addr > (uint8_t *) p->addr)
+        break;
+      q = find_page (addr);
+      if (q == NULL || !q->sequential || (f = q->frame) == NULL
+          || lock_held_by_current_thread (&f->lock)
+          || !lock_try_acquire (&f->lock))
+        continue;
+      if (f == q->frame)
+        {
+          pagedir_set_accessed (q->thread->pagedir, q->addr, false);
+          frame_deactivate (f);
+          dropped_cnt++;
+        }
+      frame_unlock (f);
+    }
+}
+
+/* Faults in page P, for writing if WRITE is true or for reading
+   otherwise.  The caller must hold the owner's page_in_lock.
+   Returns true if successful, false on failure. */
+static bool
+fault_in (struct page *p, bool write)
+{
+  bool from_file = false;
+  bool success;
+
+  frame_lock (p);
+  if (p->frame == NULL)
+    {
+      if (page_zero_fill (p))
+        {
+          if (!write)
+            return map_zero_page (p);
+          else if (maps_zero_page (p))
+            zero_copy_cnt++;
+        }
+
+      from_file = p->file != NULL && p->sector == (block_sector_t) -1;
+      if (!do_page_in (p))
+        return false;
+    }
+  else if (write && !unshare_page (p))
+    {
+      frame_unlock (p->frame);
+      return false;
+    }
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* Install frame into page table. */
+  success = map_page (p);
+  if (success && from_file)
+    fault_around (p);
+
+  /* Release frame. */
+  frame_unlock (p->frame);
+
+  return success;
+}
+
+/* Faults in the page containing FAULT_ADDR, for writing if WRITE
+   is true or for reading otherwise.  A read of a zero-fill page
+   just maps the zero page.
+   Returns true if successful, false on failure. */
+bool
+page_in (void *fault_addr, bool write)
+{
+  struct process *proc = thread_current ()->process;
+  struct page *p;
+  bool success;
+
+  /* Can't handle page faults without a hash table. */
+  if (proc == NULL || proc->pages == NULL)
+    return false;
+
+  p = page_for_addr (fault_addr);
+  if (p == NULL || (p->read_only && write))
+    return false;
+
+  lock_acquire (&proc->page_in_lock);
+  success = fault_in (p, write);
+  lock_release (&proc->page_in_lock);
+
+  if (success && p->sequential)
+    drop_behind (p);
+  return success;
+}
+
+/* Reads page P, which belongs to some other process, into a
+   frame if it has data to read and is not already in memory.
+   The frame is not mapped, so the owner's first access to P
+   takes a fault that just maps it.  Used by prefetch.c.
+   Returns true if P was brought into memory. */
+bool
+page_prefetch (struct page *p)
+{
+  struct lock *page_in_lock = &p->thread->process->page_in_lock;
+  bool success = false;
+
+  lock_acquire (page_in_lock);
+  frame_lock (p);
+  if (p->frame == NULL && !page_zero_fill (p))
+    success = do_page_in (p);
+  if (p->frame != NULL)
+    frame_unlock (p->frame);
+  lock_release (page_in_lock);
+  return success;
+}
+
+/* Stores in PAGES the current process's pages, among the
+   PAGE_CNT pages starting at ADDR, that are not in memory but
+   have data to read in.  Returns the number stored. */
+size_t
+page_gather (void *addr, size_t page_cnt, struct page **pages)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct page *p = find_page ((uint8_t *) addr + i * PGSIZE);
+      if (p != NULL && p->frame == NULL && !page_zero_fill (p))
+        pages[cnt++] = p;
+    }
+  return cnt;
+}
+
+/* Marks the current process's pages among the PAGE_CNT pages
+   starting at ADDR as being scanned sequentially, if SEQUENTIAL
+   is true, or as being used normally otherwise. */
+void
+page_set_sequential (void *addr, size_t page_cnt, bool sequential)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct page *p = find_page ((uint8_t *) addr + i * PGSIZE);
+      if (p != NULL)
+        p->sequential = sequential;
+    }
+}
+
+/* Releases the frames and swap slots of the current process's
+   pages among the PAGE_CNT pages starting at ADDR, writing
+   modified shared file pages back to their files first.  The
+   pages stay in the page table: the next access to one reads it
+   back in from its file, if it still has one, and otherwise gives
+   it a fresh page of zeros. */
+void
+page_discard (void *addr, size_t page_cnt)
+{
+  size_t i;
+
+  /* The prefetch thread may be reading these pages in. */
+  prefetch_cancel ();
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct page *p = find_page ((uint8_t *) addr + i * PGSIZE);
+      if (p != NULL)
+        {
+          if (p->frame != NULL)
+            released_cnt++;
+          release_page (p);
+        }
+    }
+}
+
+/* Returns true if evicting page P, whose frame must be locked,
+   could require writing it to swap, false if it can always be
+   recovered from its file. */
+bool
+page_swap_backed (const struct page *p)
+{
+  return p->file == NULL || p->private;
+}
+
+/* Returns true if page P's data has been accessed recently,
+   false otherwise, and clears its accessed bit so that the next
+   call reports only accesses made in between.  Pages sharing P's
+   frame count as P.  P must have a frame locked into memory. */
+bool
+page_accessed_recently (struct page *p)
+{
+  bool was_accessed = false;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  for (; p != NULL; p = p->next_sharer)
+    if (pagedir_is_accessed (p->thread->pagedir, p->addr))
+      {
+        pagedir_set_accessed (p->thread->pagedir, p->addr, false);
+        p->read_ahead = false;
+        was_accessed = true;
+      }
+  return was_accessed;
+}
+
+/* Returns true if evicting page P would require writing it to
+   swap or back to its file, false if its frame could simply be
+   dropped.  P must have a frame locked into memory. */
+bool
+page_needs_write (const struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (p->file == NULL)
+    return true;
+  for (; p != NULL; p = p->next_sharer)
+    if (pagedir_is_dirty (p->thread->pagedir, p->addr))
+      return true;
+  return false;
+}
+
+/* Marks P, and every page sharing its frame, not present in its
+   page table, forcing accesses by the processes to fault.  Other
+   CPUs may reach the pages until BATCH is flushed. */
+static void
+unmap_sharers (struct page *p, struct tlb_batch *batch)
+{
+  for (; p != NULL; p = p->next_sharer)
+    pagedir_clear_page_batch (p->thread->pagedir, p->addr, batch);
+}
+
+/* Returns true if P, or any page sharing its frame, has been
+   written.  They must have been unmapped and the TLB batch
+   flushed first, to prevent a race with a process dirtying the
+   page. */
+static bool
+sharers_dirty (struct page *p)
+{
+  for (; p != NULL; p = p->next_sharer)
+    if (pagedir_is_dirty (p->thread->pagedir, p->addr))
+      return true;
+  return false;
+}
+
+/* Records that P, and every page sharing its frame, no longer
+   has a frame. */
+static void
+detach_sharers (struct page *p)
+{
+  while (p != NULL)
+    {
+      struct page *next = p->next_sharer;
+      p->frame = NULL;
+      p->next_sharer = NULL;
+      p = next;
+    }
+}
+
+/* Evicts the CNT pages in PAGES, each of which must have a frame
+   locked by the current thread.  Clean file pages are simply
+   dropped and dirty shared file pages are written back to their
+   files.  Everything else is written to swap, as one cluster of
+   consecutive slots if possible.  Each page that is evicted, and
+   every page sharing its frame, has its `frame' member set to
+   null; the others keep their frames, and the caller must keep
+   them. */
+void
+page_out_cluster (struct page **pages, size_t cnt)
+{
+  struct page *swap_pages[SWAP_CLUSTER_PAGES];
+  struct tlb_batch batch;
+  size_t swap_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER_PAGES);
+
+  /* Unmap all the pages first, so that the other CPUs flush their
+     TLBs once for the whole cluster. */
+  tlb_batch_init (&batch);
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+
+      ASSERT (p->frame != NULL);
+      ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+      /* Reading this page ahead was a waste.  Narrow the owner's
+         read-ahead window.  (We don't lock the owner, but the
+         window is only a hint.) */
+      if (p->read_ahead
+          && !pagedir_is_accessed (p->thread->pagedir, p->addr))
+        {
+          struct process *owner = p->thread->process;
+          owner->ra_window = (owner->ra_window / 2 > READ_AHEAD_MIN
+                              ? owner->ra_window / 2 : READ_AHEAD_MIN);
+        }
+      p->read_ahead = false;
+
+      unmap_sharers (p, &batch);
+    }
+  tlb_batch_flush (&batch);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+      bool dirty;
+
+      /* Has the frame been modified? */
+      dirty = sharers_dirty (p);
+
+      if (p->file != NULL && !dirty)
+        {
+          /* The file still has the right contents. */
+          detach_sharers (p);
+        }
+      else if (p->file != NULL && !p->private)
+        {
+          /* Write the changes back to the file. */
+          off_t written;
+
+          lock_acquire (&file_lock);
+          written = file_write_at (p->file, p->frame->base,
+                                   p->file_bytes, p->file_offset);
+          lock_release (&file_lock);
+          if (written == p->file_bytes)
+            detach_sharers (p);
+        }
+      else
+        swap_pages[swap_cnt++] = p;
+    }
+
+  swap_out_cluster (swap_pages, swap_cnt);
+  for (i = 0; i < swap_cnt; i++)
+    if (swap_pages[i]->sector != (block_sector_t) -1)
+      detach_sharers (swap_pages[i]);
+}
+
+/* Returns true if page P, whose frame must be locked, may be
+   merged with other pages that hold the same data, that is, if it
+   is private, writable memory that would be written to swap on
+   eviction. */
+bool
+page_mergeable (const struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  return !p->read_only && page_swap_backed (p);
+}
+
+/* Merges frame B into frame A, both of which must be locked and
+   hold mergeable pages, if their contents are identical.  The
+   pages using B then share A, copy-on-write, and B is freed.
+   Returns true if successful.  Returns false, and leaves both
+   frames locked, if the contents differ or A would have too many
+   sharers. */
+bool
+page_merge (struct frame *a, struct frame *b)
+{
+  struct page *p, *tail = NULL;
+  struct tlb_batch batch;
+  size_t sharer_cnt = 0;
+
+  ASSERT (a != b);
+  ASSERT (lock_held_by_current_thread (&a->lock));
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  ASSERT (page_mergeable (a->page) && page_mergeable (b->page));
+
+  for (p = a->page; p != NULL; p = p->next_sharer)
+    sharer_cnt++;
+  for (p = b->page; p != NULL; p = p->next_sharer)
+    sharer_cnt++;
+  if (sharer_cnt > SWAP_MAX_SHARERS
+      || memcmp (a->base, b->base, PGSIZE))
+    return false;
+
+  /* Unmap every page first, so that none of them can be written
+     while we check again and merge.  Their next accesses fault
+     and map the merged frame read-only. */
+  tlb_batch_init (&batch);
+  unmap_sharers (a->page, &batch);
+  unmap_sharers (b->page, &batch);
+  tlb_batch_flush (&batch);
+  if (memcmp (a->base, b->base, PGSIZE))
+    return false;
+
+  /* Move B's pages to A.  Merged pages no longer necessarily
+     match their files, so make them ordinary anonymous pages. */
+  for (p = b->page; p != NULL; p = p->next_sharer)
+    {
+      p->frame = a;
+      tail = p;
+    }
+  tail->next_sharer = a->page->next_sharer;
+  a->page->next_sharer = b->page;
+  for (p = a->page; p != NULL; p = p->next_sharer)
+    {
+      p->file = NULL;
+      p->file_offset = 0;
+      p->file_bytes = 0;
+    }
+
+  frame_free (b);
+  return true;
+}
+
+/* Adds a mapping for user virtual address VADDR to the page hash
+   table.  Fails if VADDR is already mapped or if memory
+   allocation fails. */
+struct page *
+page_allocate (void *vaddr, bool read_only)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  /* Pages inside a 4 MB page are already mapped. */
+  if (pagedir_is_large (t->pagedir, vaddr, NULL))
+    return NULL;
+
+  p = malloc (sizeof *p);
+  if (p != NULL)
+    {
+      p->addr = pg_round_down (vaddr);
+
+      p->read_only = read_only;
+      p->private = !read_only;
+
+      p->frame = NULL;
+      p->next_sharer = NULL;
+      p->read_ahead = false;
+      p->sequential = false;
+
+      p->sector = (block_sector_t) -1;
+
+      p->file = NULL;
+      p->file_offset = 0;
+      p->file_bytes = 0;
+
+      p->thread = thread_current ();
+
+      if (hash_insert (t->process->pages, &p->hash_elem) != NULL)
+        {
+          /* Already mapped. */
+          free (p);
+          p = NULL;
+        }
+    }
+  return p;
+}
+
+/* Removes the page containing user virtual address VADDR from
+   the current process's page table, writing it back to its file
+   first if it is a memory-mapped page that has been written. */
+void
+page_deallocate (void *vaddr)
+{
+  struct page *p = find_page (vaddr);
+  ASSERT (p != NULL);
+  prefetch_cancel ();
+  release_page (p);
+  hash_delete (thread_current ()->process->pages, &p->hash_elem);
+  free (p);
+}
+
+/* Returns a hash value for the page that E refers to. */
+unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return ((uintptr_t) p->addr) >> PGBITS;
+}
+
+/* Returns true if page A precedes page B. */
+bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->addr < b->addr;
+}
+
+/* Locks page P into physical memory, paging it in if necessary,
+   for page_lock().  The caller must hold the owner's
+   page_in_lock.  Returns true if successful, false on failure. */
+static bool
+lock_in (struct page *p, bool will_write)
+{
+  frame_lock (p);
+  if (p->frame == NULL && !will_write && page_zero_fill (p))
+    return map_zero_page (p);
+  if (p->frame == NULL && !do_page_in (p))
+    return false;
+  if ((will_write && !unshare_page (p)) || !map_page (p))
+    {
+      frame_unlock (p->frame);
+      return false;
+    }
+  return true;
+}
+
+/* Tries to lock the page containing ADDR into physical memory.
+   If WILL_WRITE is true, the page must be writeable;
+   otherwise it may be read-only.
+   Returns true if successful, false on failure. */
+bool
+page_lock (const void *addr, bool will_write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool writable;
+  bool success;
+
+  if (t->process == NULL || t->process->pages == NULL)
+    return false;
+
+  /* 4 MB pages are never evicted, so there is nothing to lock. */
+  if (is_user_vaddr (addr) && pagedir_is_large (t->pagedir, addr, &writable))
+    return writable || !will_write;
+
+  p = page_for_addr (addr);
+  if (p == NULL || (p->read_only && will_write))
+    return false;
+
+  lock_acquire (&t->process->page_in_lock);
+  success = lock_in (p, will_write);
+  lock_release (&t->process->page_in_lock);
+  return success;
+}
+
+/* Unlocks a page locked with page_lock(). */
+void
+page_unlock (const void *addr)
+{
+  struct page *p;
+
+  if (pagedir_is_large (thread_current ()->pagedir, addr, NULL))
+    return;
+
+  p = page_for_addr (addr);
+  ASSERT (p != NULL);
+
+  /* A page locked for reading may just be mapped to the zero
+     page, which is never evicted. */
+  if (p->frame != NULL)
+    frame_unlock (p->frame);
+}
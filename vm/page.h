@@ -0,0 +1,67 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct frame;
+
+/* Virtual page. */
+struct page
+  {
+    /* Immutable members. */
+    void *addr;                 /* User virtual address. */
+    bool read_only;             /* Read-only page? */
+    struct thread *thread;      /* Owning thread. */
+
+    /* Accessed only in owning process context. */
+    struct hash_elem hash_elem; /* struct thread `pages' hash element. */
+    bool sequential;            /* Advised MADV_SEQUENTIAL? */
+
+    /* Set only in owning process context with frame->lock held.
+       Cleared only with frame->lock held. */
+    struct frame *frame;        /* Page frame. */
+    struct page *next_sharer;   /* Next page sharing frame, protected
+                                   by frame->lock. */
+    bool read_ahead;            /* Read ahead and not yet seen in use,
+                                   protected by frame->lock. */
+
+    /* Swap information, protected by frame->lock. */
+    block_sector_t sector;      /* Starting sector of swap area, or -1. */
+
+    /* Memory-mapped file information, protected by frame->lock. */
+    bool private;               /* False to write back to file,
+                                   true to write back to swap. */
+    struct file *file;          /* File. */
+    off_t file_offset;          /* Offset in file. */
+    off_t file_bytes;           /* Bytes to read/write, 1...PGSIZE. */
+  };
+
+void page_init (void);
+void page_print_stats (void);
+void page_exit (void);
+
+struct page *page_allocate (void *, bool read_only);
+void page_deallocate (void *vaddr);
+
+bool page_in (void *fault_addr, bool write);
+bool page_prefetch (struct page *);
+size_t page_gather (void *, size_t page_cnt, struct page **);
+void page_set_sequential (void *, size_t page_cnt, bool sequential);
+void page_discard (void *, size_t page_cnt);
+void page_out_cluster (struct page **, size_t cnt);
+bool page_swap_backed (const struct page *);
+bool page_accessed_recently (struct page *);
+bool page_needs_write (const struct page *);
+bool page_mergeable (const struct page *);
+bool page_merge (struct frame *, struct frame *);
+
+bool page_lock (const void *, bool will_write);
+void page_unlock (const void *);
+
+hash_hash_func page_hash;
+hash_less_func page_less;
+
+#endif /* vm/page.h */
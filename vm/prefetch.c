@@ -0,0 +1,182 @@
+#include "vm/prefetch.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include "vm/page.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Asynchronous prefetch.
+
+   A process that knows it will soon use a range of memory says
+   so with madvise(MADV_WILLNEED).  The pages in the range that
+   are not in memory are handed to a work item on system_wq, which
+   reads them in from their files or from swap while the process
+   gets on with something else.  The block layer does its I/O
+   synchronously, so the worker is what makes this asynchronous.
+
+   The pages are not mapped.  The process's first access to each
+   one takes a fault that just maps the frame waiting for it.
+
+   A request refers to the process's pages directly, so before a
+   process frees any of its pages it calls prefetch_cancel(),
+   which discards its queued requests and waits for the one in
+   progress, if it is the process's, to stop.  While the worker
+   works on a page it holds the owner's page_in_lock, so that the
+   owner cannot fault the same page in at the same time. */
+
+/* A request to read in some of a process's pages. */
+struct prefetch_request
+  {
+    struct list_elem elem;      /* Element in request_list. */
+    struct thread *thread;      /* Process that owns the pages. */
+    bool cancelled;             /* Stop as soon as possible? */
+    size_t page_cnt;            /* Number of pages. */
+    struct page *pages[];       /* Pages to read in. */
+  };
+
+/* Queued requests, oldest first. */
+static struct list request_list;
+
+/* Request the worker is working on, or a null pointer. */
+static struct prefetch_request *current;
+
+/* Works through request_list.  A work item never runs in two
+   workers at once, so there is at most one `current'. */
+static struct work prefetch_work;
+
+/* Protects request_list and current. */
+static struct lock prefetch_lock;
+static struct condition done_cond;  /* Signaled when `current' is done. */
+
+/* Statistics. */
+static long long request_cnt;   /* Requests queued. */
+static long long page_cnt;      /* Pages read in. */
+static long long cancel_cnt;    /* Requests discarded or cut short. */
+
+static work_func prefetch_work_func;
+
+/* Initializes asynchronous prefetch. */
+void
+prefetch_init (void)
+{
+  list_init (&request_list);
+  lock_init (&prefetch_lock);
+  cond_init (&done_cond);
+  work_init (&prefetch_work, prefetch_work_func, NULL);
+}
+
+/* Prints prefetch statistics. */
+void
+prefetch_print_stats (void)
+{
+  printf ("Prefetch: %lld requests, %lld pages read in, "
+          "%lld requests cancelled\n", request_cnt, page_cnt, cancel_cnt);
+}
+
+/* Queues the current process's pages among the PAGE_CNT pages
+   starting at ADDR to be read in, if they are not in memory.
+   Only the first PREFETCH_MAX_PAGES pages are considered.
+   Returns false if memory for the request could not be
+   allocated, true otherwise. */
+bool
+prefetch_request (void *addr, size_t page_cnt)
+{
+  struct prefetch_request *r;
+
+  if (page_cnt > PREFETCH_MAX_PAGES)
+    page_cnt = PREFETCH_MAX_PAGES;
+
+  r = malloc (sizeof *r + page_cnt * sizeof *r->pages);
+  if (r == NULL)
+    return false;
+  r->thread = thread_current ();
+  r->cancelled = false;
+  r->page_cnt = page_gather (addr, page_cnt, r->pages);
+  if (r->page_cnt == 0)
+    {
+      free (r);
+      return true;
+    }
+
+  lock_acquire (&prefetch_lock);
+  list_push_back (&request_list, &r->elem);
+  request_cnt++;
+  lock_release (&prefetch_lock);
+  queue_work (system_wq, &prefetch_work);
+  return true;
+}
+
+/* Discards the current process's queued requests and waits for
+   the worker to stop working on its pages. */
+void
+prefetch_cancel (void)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  lock_acquire (&prefetch_lock);
+  for (e = list_begin (&request_list); e != list_end (&request_list); )
+    {
+      struct prefetch_request *r = list_entry (e, struct prefetch_request,
+                                               elem);
+      if (r->thread == t)
+        {
+          e = list_remove (e);
+          free (r);
+          cancel_cnt++;
+        }
+      else
+        e = list_next (e);
+    }
+  while (current != NULL && current->thread == t)
+    {
+      if (!current->cancelled)
+        {
+          current->cancelled = true;
+          cancel_cnt++;
+        }
+      cond_wait (&done_cond, &prefetch_lock);
+    }
+  lock_release (&prefetch_lock);
+}
+
+/* Work function for prefetch_work.  Works through queued
+   requests in order until there are none left.  A request queued
+   after it finds the list empty queues prefetch_work again, so
+   none is left behind. */
+static void
+prefetch_work_func (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct prefetch_request *r;
+      size_t i;
+
+      lock_acquire (&prefetch_lock);
+      if (list_empty (&request_list))
+        {
+          lock_release (&prefetch_lock);
+          return;
+        }
+      r = list_entry (list_pop_front (&request_list),
+                      struct prefetch_request, elem);
+      current = r;
+      lock_release (&prefetch_lock);
+
+      /* `cancelled' only ever changes from false to true, and
+         prefetch_cancel() waits for us below in any case, so it
+         is safe to check without the lock. */
+      for (i = 0; i < r->page_cnt && !r->cancelled; i++)
+        if (page_prefetch (r->pages[i]))
+          page_cnt++;
+
+      lock_acquire (&prefetch_lock);
+      current = NULL;
+      cond_broadcast (&done_cond, &prefetch_lock);
+      lock_release (&prefetch_lock);
+      free (r);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef VM_PREFETCH_H
+#define VM_PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most pages read in for a single request. */
+#define PREFETCH_MAX_PAGES 256
+
+void prefetch_init (void);
+void prefetch_print_stats (void);
+bool prefetch_request (void *, size_t page_cnt);
+void prefetch_cancel (void);
+
+#endif /* vm/prefetch.h */
@@ -0,0 +1,542 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap device.
+
+   The swap partition is divided into page-size "slots" of
+   PAGE_SECTORS consecutive sectors each, and a bitmap records
+   which slots are in use.  A page that is swapped out occupies
+   exactly one slot until it is read back in or its process
+   exits.
+
+   Pages are usually evicted in groups (see frame.c), so
+   swap_out_cluster() tries to give a group consecutive slots and
+   writes it as one sequential run of sectors, rather than
+   scattering it across the disk one page at a time.  The group's
+   frames are not contiguous in memory, so they are gathered into
+   a bounce buffer first and go to the disk in one command.
+
+   Pages merged by ksm.c share a frame, and when that frame is
+   swapped out they share its slot as well.  Each slot has a
+   count of the pages that refer to it, and it is freed only when
+   the last of them swaps it in or goes away.
+
+   In front of the disk sits a compressed swap cache.  A page
+   swapped out to a slot is first compressed and kept in kernel
+   memory; the disk is written only when the cache outgrows its
+   budget, at which point the coldest cached slots are written
+   back in batches, in slot order.  Swapping in a cached slot
+   just decompresses it.  A moderately over-committed workload
+   thus never touches the disk.  Pages that do not compress to a
+   quarter of their size are written to disk directly. */
+
+/* The swap device. */
+static struct block *swap_device;
+
+/* Used swap slots. */
+static struct bitmap *swap_bitmap;
+
+/* Number of pages that refer to each used slot. */
+static uint8_t *slot_refs;
+
+/* Protects swap_bitmap and slot_refs. */
+static struct lock swap_lock;
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A swap slot whose contents are held compressed in memory. */
+struct cached_slot
+  {
+    struct list_elem lru_elem;  /* Element in cache_lru. */
+    size_t slot;                /* Slot number. */
+    bool writing;               /* Being written back to disk? */
+    bool freed;                 /* Slot freed during write-back? */
+    uint16_t size;              /* Bytes of compressed data. */
+    uint8_t data[];             /* Compressed page. */
+  };
+
+/* Largest cached_slot, chosen so that malloc() serves it from
+   a shared arena rather than a page of its own. */
+#define CACHE_MAX_BLOCK (PGSIZE / 4)
+#define CACHE_MAX_DATA (CACHE_MAX_BLOCK - offsetof (struct cached_slot, data))
+
+/* Cached slots, indexed by slot number.  An entry stays here
+   until its slot is freed or written back. */
+static struct cached_slot **cached;
+
+/* Cached slots that are not being written back, coldest first. */
+static struct list cache_lru;
+
+/* Bytes of compressed data the cache may hold, and the bytes it
+   holds now, counting slots being written back. */
+static size_t cache_budget = SWAP_CACHE_PAGES * PGSIZE;
+static size_t cache_used;
+
+/* Protects cached, cache_lru, cache_used, and the scratch space
+   for compression. */
+static struct lock cache_lock;
+static uint16_t lz_table[LZ_TABLE_SIZE];
+static uint8_t lz_buffer[CACHE_MAX_BLOCK];
+
+/* Serializes use of the bounce buffer, SWAP_CLUSTER_PAGES pages
+   that write-back decompresses slots into and that
+   swap_out_cluster() gathers frames into on their way to disk. */
+static struct lock writeback_lock;
+static uint8_t *bounce;
+
+/* Statistics. */
+static long long disk_read_cnt;   /* Pages read from disk. */
+static long long disk_write_cnt;  /* Pages written to disk. */
+static long long store_cnt;       /* Pages compressed into the cache. */
+static long long reject_cnt;      /* Pages too big to compress. */
+static long long hit_cnt;         /* Pages swapped in from the cache. */
+static long long writeback_cnt;   /* Cached pages written to disk. */
+
+static void write_back (void);
+
+/* Sets the compressed swap cache's budget to PAGES pages of
+   kernel memory.  0 disables the cache.  Must be called before
+   swap_init(). */
+void
+swap_set_cache_size (size_t pages)
+{
+  cache_budget = pages * PGSIZE;
+}
+
+/* Sets up swap. */
+void
+swap_init (void)
+{
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("no swap device--swap disabled\n");
+      swap_bitmap = bitmap_create (0);
+    }
+  else
+    swap_bitmap = bitmap_create (block_size (swap_device)
+                                 / PAGE_SECTORS);
+  if (swap_bitmap == NULL)
+    PANIC ("couldn't create swap bitmap");
+  slot_refs = calloc (bitmap_size (swap_bitmap) + 1, sizeof *slot_refs);
+  if (slot_refs == NULL)
+    PANIC ("couldn't create swap slot reference counts");
+  lock_init (&swap_lock);
+
+  list_init (&cache_lru);
+  lock_init (&cache_lock);
+  lock_init (&writeback_lock);
+  if (bitmap_size (swap_bitmap) == 0)
+    {
+      cache_budget = 0;
+      return;
+    }
+  bounce = palloc_get_multiple (0, SWAP_CLUSTER_PAGES);
+  if (bounce == NULL)
+    PANIC ("couldn't allocate swap bounce buffer");
+  if (cache_budget > 0)
+    {
+      cached = calloc (bitmap_size (swap_bitmap), sizeof *cached);
+      if (cached == NULL)
+        PANIC ("couldn't allocate compressed swap cache");
+    }
+}
+
+/* Removes SLOT from the cache, if it is there, because the slot
+   is being freed.  Returns true if the caller should release the
+   slot, false if the slot is being written back and write_back()
+   will release it when it is done. */
+static bool
+uncache_slot (size_t slot)
+{
+  struct cached_slot *c;
+  bool release = true;
+
+  if (cache_budget == 0)
+    return true;
+
+  lock_acquire (&cache_lock);
+  c = cached[slot];
+  if (c != NULL)
+    {
+      if (c->writing)
+        {
+          c->freed = true;
+          release = false;
+        }
+      else
+        {
+          list_remove (&c->lru_elem);
+          cached[slot] = NULL;
+          cache_used -= c->size;
+          free (c);
+        }
+    }
+  lock_release (&cache_lock);
+  return release;
+}
+
+/* Drops a reference to the swap slot that begins at SECTOR,
+   releasing the slot if that was the last one. */
+static void
+free_slot (block_sector_t sector)
+{
+  size_t slot = sector / PAGE_SECTORS;
+  bool last;
+
+  lock_acquire (&swap_lock);
+  ASSERT (slot_refs[slot] > 0);
+  last = --slot_refs[slot] == 0;
+  lock_release (&swap_lock);
+
+  /* The slot stays marked in use until it has left the cache, so
+     that it cannot be reused while a write-back of its old
+     contents is still in flight. */
+  if (last && uncache_slot (slot))
+    {
+      lock_acquire (&swap_lock);
+      bitmap_reset (swap_bitmap, slot);
+      lock_release (&swap_lock);
+    }
+}
+
+/* Reads the swap slot that begins at SECTOR into the page at
+   BASE, from the cache if possible. */
+static void
+read_slot (block_sector_t sector, void *base)
+{
+  size_t slot = sector / PAGE_SECTORS;
+
+  if (cache_budget > 0)
+    {
+      struct cached_slot *c;
+
+      lock_acquire (&cache_lock);
+      c = cached[slot];
+      if (c != NULL)
+        {
+          size_t size = lz_decompress (c->data, c->size, base, PGSIZE);
+          if (size != PGSIZE)
+            PANIC ("swap slot %zu: corrupt compressed data", slot);
+          hit_cnt++;
+
+          /* Warm again, unless it is already on its way out. */
+          if (!c->writing)
+            {
+              list_remove (&c->lru_elem);
+              list_push_back (&cache_lru, &c->lru_elem);
+            }
+          lock_release (&cache_lock);
+          return;
+        }
+      lock_release (&cache_lock);
+    }
+
+  block_read_multiple (swap_device, sector, PAGE_SECTORS, base);
+  disk_read_cnt++;
+}
+
+/* Tries to store the page at BASE in the cache as the contents
+   of SLOT.  Returns true if successful, false if the cache is
+   disabled or the page does not compress well enough. */
+static bool
+cache_slot (size_t slot, const void *base)
+{
+  struct cached_slot *c;
+  size_t size;
+  bool full;
+
+  if (cache_budget == 0)
+    return false;
+
+  lock_acquire (&cache_lock);
+  ASSERT (cached[slot] == NULL);
+  size = lz_compress (base, PGSIZE, lz_buffer, CACHE_MAX_DATA, lz_table);
+  c = size != 0 ? malloc (offsetof (struct cached_slot, data) + size) : NULL;
+  if (c == NULL)
+    {
+      reject_cnt++;
+      lock_release (&cache_lock);
+      return false;
+    }
+  c->slot = slot;
+  c->writing = c->freed = false;
+  c->size = size;
+  memcpy (c->data, lz_buffer, size);
+  cached[slot] = c;
+  list_push_back (&cache_lru, &c->lru_elem);
+  cache_used += size;
+  store_cnt++;
+  full = cache_used > cache_budget;
+  lock_release (&cache_lock);
+
+  if (full)
+    write_back ();
+  return true;
+}
+
+/* Orders cached slots by slot number. */
+static void
+sort_by_slot (struct cached_slot **batch, size_t cnt)
+{
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++)
+    {
+      struct cached_slot *c = batch[i];
+      for (j = i; j > 0 && batch[j - 1]->slot > c->slot; j--)
+        batch[j] = batch[j - 1];
+      batch[j] = c;
+    }
+}
+
+/* Writes the coldest cached slots to disk until the cache is
+   back under budget.  Slots are written in batches of up to
+   SWAP_CLUSTER_PAGES, in slot order, with runs of consecutive
+   slots written as a single run of sectors. */
+static void
+write_back (void)
+{
+  lock_acquire (&writeback_lock);
+  for (;;)
+    {
+      struct cached_slot *batch[SWAP_CLUSTER_PAGES];
+      size_t freed[SWAP_CLUSTER_PAGES];
+      size_t cnt, freed_cnt;
+      size_t i, j;
+
+      /* Take a batch of the coldest slots off the LRU list.
+         They stay in `cached', so that swap_in() still finds
+         them until they are safely on disk. */
+      lock_acquire (&cache_lock);
+      for (cnt = 0; cnt < SWAP_CLUSTER_PAGES
+             && cache_used > cache_budget - cache_budget / 8
+             && !list_empty (&cache_lru); cnt++)
+        {
+          struct list_elem *e = list_pop_front (&cache_lru);
+          batch[cnt] = list_entry (e, struct cached_slot, lru_elem);
+          batch[cnt]->writing = true;
+        }
+      lock_release (&cache_lock);
+      if (cnt == 0)
+        break;
+
+      /* Slots being written back cannot change or be freed, so
+         they can be decompressed without the cache lock. */
+      sort_by_slot (batch, cnt);
+      for (i = 0; i < cnt; i = j)
+        {
+          for (j = i; j < cnt && batch[j]->slot == batch[i]->slot + (j - i);
+               j++)
+            lz_decompress (batch[j]->data, batch[j]->size,
+                           bounce + j * PGSIZE, PGSIZE);
+          block_write_multiple (swap_device, batch[i]->slot * PAGE_SECTORS,
+                                (j - i) * PAGE_SECTORS, bounce + i * PGSIZE);
+        }
+
+      lock_acquire (&cache_lock);
+      freed_cnt = 0;
+      for (i = 0; i < cnt; i++)
+        {
+          struct cached_slot *c = batch[i];
+          if (c->freed)
+            freed[freed_cnt++] = c->slot;
+          cached[c->slot] = NULL;
+          cache_used -= c->size;
+          free (c);
+        }
+      disk_write_cnt += cnt;
+      writeback_cnt += cnt;
+      lock_release (&cache_lock);
+
+      /* Release slots freed while they were being written. */
+      if (freed_cnt > 0)
+        {
+          lock_acquire (&swap_lock);
+          for (i = 0; i < freed_cnt; i++)
+            bitmap_reset (swap_bitmap, freed[i]);
+          lock_release (&swap_lock);
+        }
+    }
+  lock_release (&writeback_lock);
+}
+
+/* Swaps in page P, which must have a locked frame
+   (and be swapped out). */
+void
+swap_in (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  ASSERT (p->sector != (block_sector_t) -1);
+
+  read_slot (p->sector, p->frame->base);
+  free_slot (p->sector);
+  p->sector = (block_sector_t) -1;
+}
+
+/* Records that page P, and every page sharing its frame, now
+   lives in the swap slot that begins at SECTOR. */
+static void
+record_slot (struct page *p, block_sector_t sector)
+{
+  size_t ref_cnt = 0;
+  struct page *q;
+
+  for (q = p->frame->page; q != NULL; q = q->next_sharer)
+    {
+      q->sector = sector;
+
+      /* A private file page that has been swapped out no longer
+         matches its file, so from now on it is an ordinary
+         anonymous page. */
+      q->private = false;
+      q->file = NULL;
+      q->file_offset = 0;
+      q->file_bytes = 0;
+      ref_cnt++;
+    }
+
+  ASSERT (ref_cnt <= SWAP_MAX_SHARERS);
+  lock_acquire (&swap_lock);
+  slot_refs[sector / PAGE_SECTORS] = ref_cnt;
+  lock_release (&swap_lock);
+}
+
+/* Writes the frames of the CNT pages in PAGES, each of which must
+   have a locked frame, to the consecutive swap slots starting at
+   SLOT, or to the cache, and records where each page now lives.
+   The pages that the cache does not take are written with one
+   command per run of consecutive slots, gathered through the
+   bounce buffer. */
+static void
+write_slots (struct page **pages, size_t cnt, size_t slot)
+{
+  bool to_disk[SWAP_CLUSTER_PAGES];
+  size_t i, j, k;
+
+  ASSERT (cnt <= SWAP_CLUSTER_PAGES);
+
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (pages[i]->frame != NULL);
+      ASSERT (lock_held_by_current_thread (&pages[i]->frame->lock));
+      to_disk[i] = !cache_slot (slot + i, pages[i]->frame->base);
+    }
+
+  for (i = 0; i < cnt; i = j)
+    {
+      if (!to_disk[i])
+        {
+          j = i + 1;
+          continue;
+        }
+      for (j = i + 1; j < cnt && to_disk[j]; j++)
+        continue;
+
+      if (j - i == 1)
+        block_write_multiple (swap_device, (slot + i) * PAGE_SECTORS,
+                              PAGE_SECTORS, pages[i]->frame->base);
+      else
+        {
+          lock_acquire (&writeback_lock);
+          for (k = i; k < j; k++)
+            memcpy (bounce + (k - i) * PGSIZE, pages[k]->frame->base, PGSIZE);
+          block_write_multiple (swap_device, (slot + i) * PAGE_SECTORS,
+                                (j - i) * PAGE_SECTORS, bounce);
+          lock_release (&writeback_lock);
+        }
+      disk_write_cnt += j - i;
+    }
+
+  for (i = 0; i < cnt; i++)
+    record_slot (pages[i], (slot + i) * PAGE_SECTORS);
+}
+
+/* Swaps out page P, which must have a locked frame.
+   Returns true if successful, false if swap is full. */
+bool
+swap_out (struct page *p)
+{
+  return swap_out_cluster (&p, 1) == 1;
+}
+
+/* Swaps out the CNT pages in PAGES, each of which must have a
+   locked frame.  CNT may be at most SWAP_CLUSTER_PAGES.  If CNT
+   consecutive slots are free, the pages are written as a single
+   run of sectors in the order given;
+   otherwise each page goes to whatever slot is free.  Each page
+   that is written has its `sector' set.  Returns the number of
+   pages written, which is less than CNT only if swap is full. */
+size_t
+swap_out_cluster (struct page **pages, size_t cnt)
+{
+  size_t slot;
+  size_t i;
+
+  if (cnt == 0)
+    return 0;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  lock_release (&swap_lock);
+
+  if (slot != BITMAP_ERROR)
+    {
+      write_slots (pages, cnt, slot);
+      return cnt;
+    }
+
+  /* Swap is full, or too fragmented for a single run.  In the
+     latter case, fall back to placing the pages one at a time. */
+  if (cnt == 1)
+    return 0;
+  for (i = 0; i < cnt; i++)
+    {
+      lock_acquire (&swap_lock);
+      slot = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+      lock_release (&swap_lock);
+      if (slot == BITMAP_ERROR)
+        break;
+      write_slots (&pages[i], 1, slot);
+    }
+  return i;
+}
+
+/* Frees the swap slot held by page P, if any, without reading it
+   back in.  Used when P is being destroyed. */
+void
+swap_discard (struct page *p)
+{
+  if (p->sector != (block_sector_t) -1)
+    {
+      free_slot (p->sector);
+      p->sector = (block_sector_t) -1;
+    }
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages written to disk, %lld read from disk\n",
+          disk_write_cnt, disk_read_cnt);
+  printf ("Swap cache: %lld pages stored, %lld rejected, %lld hits, "
+          "%lld written back\n", store_cnt, reject_cnt, hit_cnt,
+          writeback_cnt);
+}
@@ -0,0 +1,25 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Maximum number of pages written to swap in one burst. */
+#define SWAP_CLUSTER_PAGES 8
+
+/* Default budget of the compressed swap cache, in pages. */
+#define SWAP_CACHE_PAGES 32
+
+/* Maximum number of pages that can share one swap slot. */
+#define SWAP_MAX_SHARERS 255
+
+struct page;
+void swap_set_cache_size (size_t pages);
+void swap_init (void);
+void swap_print_stats (void);
+void swap_in (struct page *);
+bool swap_out (struct page *);
+size_t swap_out_cluster (struct page **, size_t cnt);
+void swap_discard (struct page *);
+
+#endif /* vm/swap.h */